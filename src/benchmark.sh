@@ -0,0 +1,5 @@
+#!/bin/bash
+
+cd build
+cmake -Dbenchmark=ON ..
+make
\ No newline at end of file
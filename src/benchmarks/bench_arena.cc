@@ -0,0 +1,60 @@
+// zero_copy_value payloads: make_shared (one malloc/free each) vs a per-request arena (released at once)
+// every request creates VALUES_PER_REQUEST values, keeps them until it ends, then drops them all.
+
+#include "zero_copy_value.hpp"
+#include "arena.hpp"
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace eventual;
+using namespace std;
+
+static const size_t NR_REQUESTS = 20000;
+static const size_t VALUES_PER_REQUEST = 200;
+
+struct record {
+    char bytes[64];
+    record() { bytes[0] = 1; }
+};
+
+template <class Request>
+static double run(size_t nr_threads, Request request)
+{
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (size_t t = 0; t < nr_threads; t++) {
+        threads.emplace_back([&]{
+            vector<zero_copy_value> values;
+            values.reserve(VALUES_PER_REQUEST);
+            for (size_t r = 0; r < NR_REQUESTS / nr_threads; r++) {
+                request(values);
+                values.clear();
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    auto elapsed = chrono::steady_clock::now() - start;
+    return chrono::duration<double, nano>(elapsed).count() / (NR_REQUESTS / nr_threads * nr_threads * VALUES_PER_REQUEST);
+}
+
+int main()
+{
+    auto heap = [](vector<zero_copy_value>& values){
+        for (size_t i = 0; i < VALUES_PER_REQUEST; i++) values.push_back(zero_copy_value::make<record>());
+    };
+    auto in_arena = [](vector<zero_copy_value>& values){
+        auto a = make_shared<arena>(16 * 1024);
+        arena::scope in(a);
+        for (size_t i = 0; i < VALUES_PER_REQUEST; i++) values.push_back(zero_copy_value::make<record>());
+    };
+    run(1, heap); // warm up
+    run(1, in_arena);
+    printf("%zu requests x %zu values of %zu bytes\n", NR_REQUESTS, VALUES_PER_REQUEST, sizeof(record));
+    printf("%8s %20s %20s\n", "threads", "make_shared(ns/v)", "arena(ns/v)");
+    for (size_t t = 1; t <= 8; t *= 2) {
+        printf("%8zu %20.1f %20.1f\n", t, run(t, heap), run(t, in_arena));
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+// reading a shared configuration value on every task: a mutex-guarded value, std::atomic_load of a shared_ptr,
+// and atomic_value (load copies the snapshot, read visits it in place). one writer replaces the value every millisecond.
+
+#include "atomic_value.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace eventual;
+using namespace std;
+
+static const size_t NR_READS = 4000000;
+
+template <class Read, class Write>
+static double run(size_t nr_threads, Read read, Write write)
+{
+    atomic<bool> stop(false);
+    thread writer([&]{
+        for (int version = 0; !stop.load(); version++) {
+            write(version);
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    });
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    atomic<size_t> sink(0);
+    for (size_t t = 0; t < nr_threads; t++) {
+        threads.emplace_back([&]{
+            size_t sum = 0;
+            for (size_t i = 0; i < NR_READS / nr_threads; i++) sum += read();
+            sink += sum;
+        });
+    }
+    for (auto& t : threads) t.join();
+    auto elapsed = chrono::steady_clock::now() - start;
+    stop = true;
+    writer.join();
+    return chrono::duration<double, nano>(elapsed).count() / (NR_READS / nr_threads * nr_threads);
+}
+
+int main()
+{
+    mutex mtx;
+    zero_copy_value guarded(string("config"));
+    auto mutex_read = [&]{ lock_guard<mutex> lk(mtx); zero_copy_value v = guarded; return v.cref<string>().size(); };
+    auto mutex_write = [&](int version){ zero_copy_value v(to_string(version)); lock_guard<mutex> lk(mtx); guarded = v; };
+
+    shared_ptr<zero_copy_value> shared = make_shared<zero_copy_value>(string("config"));
+    auto shared_read = [&]{ return atomic_load(&shared)->cref<string>().size(); };
+    auto shared_write = [&](int version){ atomic_store(&shared, make_shared<zero_copy_value>(to_string(version))); };
+
+    atomic_value cell(string("config"));
+    auto cell_load = [&]{ return cell.load().cref<string>().size(); };
+    auto cell_read = [&]{ return cell.read([](const zero_copy_value& v){ return v.cref<string>().size(); }); };
+    auto cell_write = [&](int version){ cell.store(to_string(version)); };
+
+    run(1, mutex_read, mutex_write); // warm up
+    printf("%zu reads, a write every millisecond\n", NR_READS);
+    printf("%8s %14s %18s %20s %20s\n", "threads", "mutex(ns/r)", "atomic_load(ns/r)", "atomic_value.load", "atomic_value.read");
+    for (size_t t = 1; t <= 8; t *= 2) {
+        printf("%8zu %14.1f %18.1f %20.1f %20.1f\n", t, run(t, mutex_read, mutex_write), run(t, shared_read, shared_write),
+            run(t, cell_load, cell_write), run(t, cell_read, cell_write));
+    }
+    return 0;
+}
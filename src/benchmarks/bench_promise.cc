@@ -0,0 +1,63 @@
+// promise throughput: build many then chains, settle them, wait for the tails
+// prints wall time and what the pool (pool.hpp) served, with and without inline continuations
+
+#include "promise.h"
+#include "pool.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace eventual;
+using namespace std;
+
+static const size_t NR_CHAINS = 20000;
+static const size_t CHAIN_LENGTH = 8;
+
+static void run_chains(const char* mode)
+{
+    atomic<size_t> done{0};
+    pool::stats_t before = pool::stats();
+    auto start = chrono::steady_clock::now();
+    vector<promise_t::fulfill_func> heads;
+    vector<promise_t> roots;
+    heads.reserve(NR_CHAINS);
+    roots.reserve(NR_CHAINS);
+    for (size_t i = 0; i < NR_CHAINS; i++) {
+        promise_t::fulfill_func fulfill;
+        roots.emplace_back([&](promise_t::fulfill_func f, promise_t::reject_func){ fulfill = f; });
+        heads.push_back(fulfill);
+        promise_t p = roots.back();
+        for (size_t k = 0; k < CHAIN_LENGTH; k++) {
+            p = p.then([](value_t v){ return value_t(v.data<int>() + 1); }, nullptr);
+        }
+        p.then([&](value_t v){ done++; return v; }, nullptr);
+    }
+    auto built = chrono::steady_clock::now();
+    for (auto& f : heads) f(value_t(0));
+    while (done.load() != NR_CHAINS) this_thread::yield();
+    auto end = chrono::steady_clock::now();
+    pool::stats_t after = pool::stats();
+
+    double build_ms = chrono::duration<double, milli>(built - start).count();
+    double run_ms = chrono::duration<double, milli>(end - built).count();
+    size_t links = NR_CHAINS * (CHAIN_LENGTH + 1);
+    printf("[%s] %zu chains x %zu links\n", mode, NR_CHAINS, CHAIN_LENGTH + 1);
+    printf("build: %.2f ms, run: %.2f ms (%.1f ns/link)\n", build_ms, run_ms, run_ms * 1e6 / links);
+    printf("pool: %llu allocations, %llu frees (%llu remote), %llu slabs, %llu large\n",
+        (unsigned long long)(after.allocations - before.allocations),
+        (unsigned long long)(after.deallocations - before.deallocations),
+        (unsigned long long)(after.remote_frees - before.remote_frees),
+        (unsigned long long)(after.slabs - before.slabs),
+        (unsigned long long)(after.large - before.large));
+}
+
+int main()
+{
+    promise_engine::instance().set_inline_budget(0, chrono::nanoseconds(0));
+    run_chains("queue every link");
+    promise_engine::instance().set_inline_budget(32, chrono::microseconds(50));
+    run_chains("inline up to 32 links / 50us");
+    return 0;
+}
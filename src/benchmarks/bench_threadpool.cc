@@ -0,0 +1,60 @@
+// threadpool vs stealing_threadpool
+// S submitter threads (1..64) push tasks from outside the pool; every task fans out
+// FANOUT children from inside the pool, which is how promise continuations behave.
+
+#include "threadpool.hpp"
+#include "stealing_threadpool.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace eventual;
+using namespace std;
+
+static const size_t NR_WORKERS = 32;
+static const size_t NR_ROOTS = 1 << 16;
+static const size_t FANOUT = 4;
+
+template <class Pool>
+static double run_once(Pool& pool, size_t nr_submitters)
+{
+    atomic<size_t> done{0};
+    const size_t expected = NR_ROOTS * (1 + FANOUT);
+    auto start = chrono::steady_clock::now();
+    vector<thread> submitters;
+    for (size_t s = 0; s < nr_submitters; s++) {
+        submitters.emplace_back([&, s]{
+            for (size_t i = s; i < NR_ROOTS; i += nr_submitters) {
+                pool.run([&]{
+                    for (size_t k = 0; k < FANOUT; k++) {
+                        pool.run([&]{ done.fetch_add(1, memory_order_relaxed); });
+                    }
+                    done.fetch_add(1, memory_order_relaxed);
+                });
+            }
+        });
+    }
+    for (auto& t : submitters) t.join();
+    while (done.load() != expected) this_thread::yield();
+    auto elapsed = chrono::steady_clock::now() - start;
+    return chrono::duration<double, milli>(elapsed).count();
+}
+
+int main()
+{
+    threadpool locked(NR_WORKERS);
+    stealing_threadpool stealing(NR_WORKERS);
+    run_once(locked, 4); // warm up
+    run_once(stealing, 4);
+    const double total = NR_ROOTS * (1 + FANOUT) / 1e6;
+    printf("%zu workers, %zu tasks per round\n", NR_WORKERS, (size_t)(NR_ROOTS * (1 + FANOUT)));
+    printf("%10s %16s %16s %16s %16s\n", "submitters", "locked(ms)", "locked(M/s)", "stealing(ms)", "stealing(M/s)");
+    for (size_t s = 1; s <= 64; s *= 2) {
+        double a = run_once(locked, s);
+        double b = run_once(stealing, s);
+        printf("%10zu %16.2f %16.2f %16.2f %16.2f\n", s, a, total / a * 1e3, b, total / b * 1e3);
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+// timer_service with a million concurrent timers:
+// cost of schedule and cancel, and how late timers fire when a million of them expire over one second
+
+#include "timer.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace eventual;
+using namespace std;
+
+static const size_t NR_TIMERS = 1000000;
+
+int main()
+{
+    atomic<size_t> fired{0};
+    atomic<int64_t> max_late_us{0};
+    timer_service timers([](task t){ t(); });
+    mt19937 rng(1);
+    uniform_int_distribution<int> ms(0, 1000);
+    vector<timer_id> ids(NR_TIMERS);
+
+    // schedule far away so that nothing fires while measuring, then cancel everything
+    auto far = chrono::steady_clock::now() + chrono::hours(1);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < NR_TIMERS; i++) {
+        ids[i] = timers.schedule(far + chrono::milliseconds(ms(rng)), []{});
+    }
+    auto scheduled = chrono::steady_clock::now();
+    for (size_t i = 0; i < NR_TIMERS; i++) timers.cancel(ids[i]);
+    auto cancelled = chrono::steady_clock::now();
+    printf("%zu timers: schedule %.1f ns/op, cancel %.1f ns/op\n", NR_TIMERS,
+        chrono::duration<double, nano>(scheduled - start).count() / NR_TIMERS,
+        chrono::duration<double, nano>(cancelled - scheduled).count() / NR_TIMERS);
+
+    // a million deadlines spread over one second, starting once they are all scheduled
+    start = chrono::steady_clock::now() + chrono::milliseconds(500);
+    for (size_t i = 0; i < NR_TIMERS; i++) {
+        auto when = start + chrono::milliseconds(ms(rng));
+        timers.schedule(when, [&, when]{
+            int64_t late = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - when).count();
+            if (late > max_late_us.load(memory_order_relaxed)) max_late_us.store(late, memory_order_relaxed);
+            fired.fetch_add(1, memory_order_relaxed);
+        });
+    }
+    while (fired.load() != NR_TIMERS) this_thread::sleep_for(chrono::milliseconds(1));
+    printf("%zu timers fired in %.1f ms, at most %.2f ms late\n", NR_TIMERS,
+        chrono::duration<double, milli>(chrono::steady_clock::now() - start).count(),
+        max_late_us.load() / 1000.0);
+    return 0;
+}
@@ -0,0 +1,82 @@
+// the samples/sample.cc workflow, todo{job0}(job1)(job2)(job3)(job4,job3_err)[job4_err](), built and run over and over:
+// todo (std::function steps in a std::list) vs make_todo (steps known at compile time).
+// providers either complete inline, inside the step, or on a service thread, as the sample's services would.
+// then, per request asynchronous runs: a todo built and run_async'ed for every request vs one todo_plan run for every request
+
+#include "todo.hpp"
+#include "static_todo.hpp"
+#include "threadpool.hpp"
+#include "todo_plan.hpp"
+#include <chrono>
+#include <cstdio>
+
+using namespace eventual;
+using namespace std;
+
+static const size_t NR_INLINE = 200000;
+static const size_t NR_THREADED = 20000;
+
+// what a provider keeps of the chain until it wakes it: a todo shares its meta, a todo_context stays where it is
+struct todo_handle {
+    todo t;
+    todo* operator->() { return &t; }
+};
+static todo_handle hold(todo* t) { return todo_handle{*t}; }
+static todo_context* hold(todo_context* c) { return c; }
+
+template <class Run>
+static double measure(size_t n, Run run)
+{
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) run();
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / n;
+}
+
+template <class Service>
+static void workflow(double& dynamic, double& compiled, size_t n, Service service)
+{
+    auto job = [service](auto* self) { service(hold(self), true); };
+    auto job3 = [service](auto* self) { service(hold(self), false); }; // the decoding service rejects, so the error path runs
+    auto job_err = [](auto* self) { self->finish(); self->wake(); };
+    dynamic = measure(n, [&]{ todo{job}(job)(job)(job3)(job, job_err)[job_err](); });
+    compiled = measure(n, [&]{ make_todo(job)(job)(job)(job3)(job, job_err)[job_err](); });
+}
+
+int main()
+{
+    double dynamic, compiled;
+    printf("%-24s %16s %20s\n", "providers", "todo(ns/chain)", "make_todo(ns/chain)");
+    auto in_step = [](auto self, bool ok) {
+        if (ok) self->resolve();
+        else self->reject();
+        self->wake();
+    };
+    workflow(dynamic, compiled, NR_INLINE, in_step);
+    printf("%-24s %16.0f %20.0f\n", "inline", dynamic, compiled);
+
+    threadpool services(1);
+    auto on_service = [&services](auto self, bool ok) {
+        services.run([self, ok]() mutable {
+            if (ok) self->resolve();
+            else self->reject();
+            self->wake();
+        });
+    };
+    workflow(dynamic, compiled, NR_THREADED, on_service);
+    printf("%-24s %16.0f %20.0f\n", "service thread", dynamic, compiled);
+
+    // inline executor and providers: what is left is the cost of setting a run up and stepping it
+    auto inline_executor = [](task t) { t(); };
+    auto step = [](auto* self) { self->resolve(); self->wake(); };
+    auto step3 = [](auto* self) { self->reject(); self->wake(); };
+    auto step_err = [](auto* self) { self->finish(); self->wake(); };
+    double built = measure(NR_INLINE, [&]{
+        todo{step}(step)(step)(step3)(step, step_err)[step_err].run_async(inline_executor);
+    });
+    todo_plan plan(inline_executor, step);
+    plan(step)(step)(step3)(step, step_err)[step_err];
+    double planned = measure(NR_INLINE, [&]{ plan.run(); });
+    printf("\n%-24s %16s %20s\n", "async runs", "todo(ns/run)", "todo_plan(ns/run)");
+    printf("%-24s %16.0f %20.0f\n", "inline", built, planned);
+    return 0;
+}
@@ -0,0 +1,65 @@
+// step-to-step latency of a blocking todo::run: every step hands a request to a provider thread, which completes it at once.
+// the runner parks after each hand-off, so one step is a full round trip: request, completion, wakeup of the runner.
+// the provider completes either with resolve(); wake(); or with complete(resolved)
+
+#include "todo.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+using namespace eventual;
+using namespace std;
+
+static const size_t CHAIN_LENGTH = 1000;
+static const size_t NR_CHAINS = 50;
+
+struct provider {
+    atomic<todo*> request{nullptr};
+    atomic<bool> stop{false};
+    atomic<bool> use_complete{false};
+    thread worker;
+
+    provider() : worker([this]{
+        while (!stop.load(memory_order_relaxed)) {
+            todo* t = request.exchange(nullptr, memory_order_acquire);
+            if (t == nullptr) {
+                this_thread::yield();
+                continue;
+            }
+            todo self(*t);
+            if (use_complete.load(memory_order_relaxed)) {
+                self.complete(todo::resolved);
+            } else {
+                self.resolve();
+                self.wake();
+            }
+        }
+    }){}
+    ~provider() {
+        stop = true;
+        worker.join();
+    }
+};
+
+static double run(provider& p)
+{
+    auto step = [&p](todo* self) { p.request.store(self, memory_order_release); };
+    todo chain{step};
+    for (size_t i = 1; i < CHAIN_LENGTH; i++) chain(step);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < NR_CHAINS; i++) chain.run();
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / (CHAIN_LENGTH * NR_CHAINS);
+}
+
+int main()
+{
+    provider p;
+    run(p); // warm up
+    printf("%zu chains of %zu steps\n", NR_CHAINS, CHAIN_LENGTH);
+    printf("%-24s %12s\n", "provider completes with", "ns/step");
+    printf("%-24s %12.0f\n", "resolve(); wake();", run(p));
+    p.use_complete.store(true, memory_order_relaxed);
+    printf("%-24s %12.0f\n", "complete(resolved)", run(p));
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+
+/*
+arena: a per-request bump allocator
+
+    1. allocating is one CAS on the current chunk; a full chunk is followed by a new one, nothing is freed one by one
+    2. every chunk goes back to the system at once, when the arena is destroyed and no block from arena_allocator is still in use
+    3. arena::scope makes an arena current on this thread: zero_copy_value puts the payloads it creates meanwhile into it,
+       and promise_t makes its chain's arena current while running the chain's callbacks
+    4. a block from arena_allocator costs one atomic increment and one decrement, so a value that outlives its request
+       still points into valid memory; the allocator itself is a plain pointer, copying it is free
+*/
+
+namespace eventual{
+
+template<typename T>
+struct arena_allocator;
+
+class arena{
+public:
+    static constexpr size_t default_chunk_size = 64 * 1024;
+
+    explicit arena(size_t chunk_size = default_chunk_size) : core_(new core_t(chunk_size)){}
+    arena(const arena&) = delete;
+    arena& operator= (const arena&) = delete;
+    ~arena(){
+        core_->release();
+    }
+
+    // thread-safe; the memory stays valid until the arena is destroyed
+    void* allocate(size_t n, size_t align=alignof(std::max_align_t)){
+        return core_->allocate(n, align);
+    }
+    // bytes handed out by the chunks so far (padding included)
+    size_t used() const noexcept{
+        size_t total=0;
+        for(chunk_t* c=core_->head.load(std::memory_order_acquire); c!=nullptr; c=c->next) total+=c->used.load(std::memory_order_relaxed);
+        return total;
+    }
+    size_t chunks() const noexcept{
+        size_t n=0;
+        for(chunk_t* c=core_->head.load(std::memory_order_acquire); c!=nullptr; c=c->next) n++;
+        return n;
+    }
+
+    // the arena made current on this thread by the innermost scope, or nullptr
+    static arena* current() noexcept{
+        return current_slot();
+    }
+    class scope{
+    public:
+        // a null arena leaves the current one in place
+        explicit scope(const std::shared_ptr<arena>& a) noexcept : prev_(current_slot()), active_(a!=nullptr){
+            if(active_) current_slot()=a.get();
+        }
+        scope(const scope&) = delete;
+        ~scope(){
+            if(active_) current_slot()=prev_;
+        }
+    private:
+        arena* prev_;
+        bool active_;
+    };
+
+private:
+    template<typename T>
+    friend struct arena_allocator;
+
+    struct alignas(std::max_align_t) chunk_t{
+        chunk_t*            next;
+        size_t              size;
+        std::atomic<size_t> used;
+        chunk_t(chunk_t* next, size_t size) noexcept : next(next), size(size), used(0){}
+        char* data() noexcept{
+            return reinterpret_cast<char*>(this+1);
+        }
+    };
+
+    // the chunks; referenced by the arena and by every live block of arena_allocator
+    struct core_t{
+        const size_t            chunk_size;
+        std::atomic<chunk_t*>   head{nullptr};
+        std::atomic<size_t>     refs{1};
+        std::mutex              mtx;
+
+        explicit core_t(size_t chunk_size) : chunk_size(chunk_size){}
+        ~core_t(){
+            chunk_t* c=head.load(std::memory_order_relaxed);
+            while(c!=nullptr){
+                chunk_t* next=c->next;
+                ::operator delete(c);
+                c=next;
+            }
+        }
+        void acquire() noexcept{
+            refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        void release() noexcept{
+            if(refs.fetch_sub(1, std::memory_order_acq_rel)==1) delete this;
+        }
+        void* allocate(size_t n, size_t align){
+            for(;;){
+                chunk_t* c=head.load(std::memory_order_acquire);
+                if(c!=nullptr){
+                    uintptr_t base=reinterpret_cast<uintptr_t>(c->data());
+                    size_t used=c->used.load(std::memory_order_relaxed);
+                    for(;;){
+                        size_t start=((base+used+align-1)&~(uintptr_t)(align-1))-base;
+                        if(start+n>c->size) break;
+                        if(c->used.compare_exchange_weak(used, start+n, std::memory_order_relaxed)){
+                            return c->data()+start;
+                        }
+                    }
+                }
+                grow(c, n+align);
+            }
+        }
+        // install a new chunk, unless another thread has already replaced full
+        void grow(chunk_t* full, size_t at_least){
+            std::lock_guard<std::mutex> lk(mtx);
+            if(head.load(std::memory_order_relaxed)!=full) return;
+            size_t size=at_least>chunk_size ? at_least : chunk_size;
+            chunk_t* c=new (::operator new(sizeof(chunk_t)+size)) chunk_t(full, size);
+            head.store(c, std::memory_order_release);
+        }
+    };
+
+    static arena*& current_slot() noexcept{
+        static thread_local arena* slot=nullptr;
+        return slot;
+    }
+
+    core_t* core_;
+};
+
+// std allocator on top of arena, for std::allocate_shared; 
+// each block keeps the arena's memory alive until it is deallocated, which frees nothing by itself
+template<typename T>
+struct arena_allocator{
+    using value_type = T;
+    explicit arena_allocator(arena& a) noexcept : core(a.core_){}
+    template<typename U>
+    arena_allocator(const arena_allocator<U>& d) noexcept : core(d.core){}
+    T* allocate(size_t n){
+        void* p=core->allocate(n*sizeof(T), alignof(T));
+        core->acquire();
+        return static_cast<T*>(p);
+    }
+    void deallocate(T*, size_t) noexcept{
+        core->release();
+    }
+    template<typename U>
+    bool operator== (const arena_allocator<U>& d) const noexcept{
+        return core==d.core;
+    }
+    template<typename U>
+    bool operator!= (const arena_allocator<U>& d) const noexcept{
+        return core!=d.core;
+    }
+    arena::core_t* core;
+};
+
+}
@@ -0,0 +1,193 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "zero_copy_value.hpp"
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/*
+atomic_value: a zero_copy_value cell for data that is read all the time and replaced rarely (configuration, routing tables, ...)
+
+    1. load() and read() are wait-free: a reader announces the epoch it entered in, reads the current snapshot, and leaves;
+       no lock, no retry loop, and read() touches no reference count at all
+    2. store() publishes a new snapshot with one atomic exchange, then retires the old one: it is deleted once every reader
+       that may still see it has left, checked on later stores and on destruction (epoch-based reclamation)
+    3. all cells share one epoch_domain; every thread that reads gets a slot in it on its first read, reused after the thread exits
+*/
+
+namespace eventual{
+
+class epoch_domain{
+    struct slot;
+public:
+    static epoch_domain& instance()
+    {
+        static epoch_domain instance;
+        return instance;
+    }
+    // marks this thread as reading for its lifetime; guards nest
+    class guard{
+    public:
+        guard() : s(epoch_domain::instance().local())
+        {
+            if(s->depth++==0){
+                // the announcement must be visible before the snapshot pointer is loaded, hence seq_cst
+                s->epoch.store(epoch_domain::instance().epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+            }
+        }
+        ~guard()
+        {
+            if(--s->depth==0) s->epoch.store(quiescent, std::memory_order_release);
+        }
+        guard(const guard&)=delete;
+        guard& operator=(const guard&)=delete;
+    private:
+        slot* s;
+    };
+    // starts a new epoch and returns it: readers that entered before it may still see what was retired before it
+    uint64_t advance() noexcept
+    {
+        return epoch.fetch_add(1, std::memory_order_seq_cst)+1;
+    }
+    // the oldest epoch a reader is still in, or max() if none is reading
+    uint64_t oldest_reader() const noexcept
+    {
+        uint64_t oldest=std::numeric_limits<uint64_t>::max();
+        for(slot* s=slots.load(std::memory_order_acquire); s!=nullptr; s=s->next){
+            uint64_t e=s->epoch.load(std::memory_order_seq_cst);
+            if(e!=quiescent && e<oldest) oldest=e;
+        }
+        return oldest;
+    }
+private:
+    static constexpr uint64_t quiescent = 0;
+
+    struct slot{
+        std::atomic<uint64_t> epoch{quiescent};
+        std::atomic<bool> taken{true};
+        int depth=0;        // only touched by the owning thread
+        slot* next=nullptr; // slots are never freed, the list only grows
+        char pad[64];       // keeps readers' slots off each other's cache lines
+    };
+    // a thread's slot goes back to the domain when the thread exits
+    struct owner{
+        slot* s;
+        ~owner(){ s->taken.store(false, std::memory_order_release); }
+    };
+
+    epoch_domain() : epoch(1), slots(nullptr){}
+    slot* local()
+    {
+        static thread_local owner mine{acquire()};
+        return mine.s;
+    }
+    slot* acquire()
+    {
+        for(slot* s=slots.load(std::memory_order_acquire); s!=nullptr; s=s->next){
+            bool expected=false;
+            if(!s->taken.load(std::memory_order_relaxed) && s->taken.compare_exchange_strong(expected, true)) return s;
+        }
+        slot* s=new slot;
+        s->next=slots.load(std::memory_order_relaxed);
+        while(!slots.compare_exchange_weak(s->next, s, std::memory_order_release, std::memory_order_relaxed));
+        return s;
+    }
+
+    std::atomic<uint64_t> epoch;
+    std::atomic<slot*> slots;
+};
+
+class atomic_value{
+public:
+    explicit atomic_value(zero_copy_value initial=zero_copy_value()) : current(new zero_copy_value(std::move(initial.share()))){}
+    ~atomic_value()
+    {
+        // like any object, a cell must outlive its readers
+        delete current.load(std::memory_order_relaxed);
+        for(auto& r : retired) delete r.first;
+    }
+    atomic_value(const atomic_value&)=delete;
+    atomic_value& operator=(const atomic_value&)=delete;
+
+    // the current snapshot; the copy shares its payload
+    zero_copy_value load() const
+    {
+        epoch_domain::guard g;
+        return *current.load(std::memory_order_seq_cst);
+    }
+    // f(const zero_copy_value&) on the current snapshot, which stays valid while f runs; keep f short, it delays reclamation
+    template<typename F>
+    auto read(F&& f) const -> decltype(f(std::declval<const zero_copy_value&>()))
+    {
+        epoch_domain::guard g;
+        return f(*current.load(std::memory_order_seq_cst));
+    }
+    // publish v; readers that already hold the old snapshot keep it until they leave
+    void store(zero_copy_value v)
+    {
+        v.share(); // readers copy it concurrently
+        zero_copy_value* next=new zero_copy_value(std::move(v));
+        std::lock_guard<std::mutex> lk(mtx);
+        zero_copy_value* old=current.exchange(next, std::memory_order_seq_cst);
+        retired.emplace_back(old, epoch_domain::instance().advance());
+        reclaim_locked();
+    }
+    // delete retired snapshots no reader can see any more; store() does this already
+    void reclaim()
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        reclaim_locked();
+    }
+    // retired snapshots still waiting for readers
+    size_t pending() const
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        return retired.size();
+    }
+private:
+    void reclaim_locked()
+    {
+        uint64_t oldest=epoch_domain::instance().oldest_reader();
+        size_t kept=0;
+        for(auto& r : retired){
+            // a reader that entered in epoch e>=r.second loaded the pointer after it was replaced
+            if(oldest>=r.second) delete r.first;
+            else retired[kept++]=r;
+        }
+        retired.resize(kept);
+    }
+
+    std::atomic<zero_copy_value*> current;
+    mutable std::mutex mtx;    // serializes writers only
+    std::vector<std::pair<zero_copy_value*, uint64_t>> retired;
+};
+
+}
@@ -0,0 +1,73 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+/*
+Cooperative cancellation
+
+    1. a cancellation_source owns the flag; it hands out any number of cancellation_tokens that observe it
+    2. cancel() is a single atomic store; whoever holds a token decides where to check it
+    3. a default constructed token can never be cancelled and costs nothing to copy
+*/
+
+namespace eventual{
+
+class cancellation_token{
+public:
+    cancellation_token() noexcept{}
+    bool is_cancelled() const noexcept{
+        return flag!=nullptr && flag->load(std::memory_order_acquire);
+    }
+    // can this token ever be cancelled?
+    bool can_be_cancelled() const noexcept{
+        return flag!=nullptr;
+    }
+private:
+    friend class cancellation_source;
+    explicit cancellation_token(std::shared_ptr<std::atomic<bool>> f) : flag(std::move(f)){}
+    std::shared_ptr<std::atomic<bool>> flag;
+};
+
+class cancellation_source{
+public:
+    cancellation_source() : flag(std::make_shared<std::atomic<bool>>(false)){}
+    cancellation_token token() const{
+        return cancellation_token(flag);
+    }
+    void cancel() noexcept{
+        flag->store(true, std::memory_order_release);
+    }
+    bool is_cancelled() const noexcept{
+        return flag->load(std::memory_order_acquire);
+    }
+private:
+    std::shared_ptr<std::atomic<bool>> flag;
+};
+
+}
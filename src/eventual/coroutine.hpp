@@ -0,0 +1,245 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "promise.h"
+
+/*
+C++20 coroutines on top of promise_t (build with -Dcxx20=ON; this header is empty before C++20)
+
+    1. co_await a promise_t gives its value, or throws its reason; a promise that has settled already is read in place, without suspending
+    2. otherwise the coroutine is resumed by the engine worker that observes the settlement, with no extra queue hop
+    3. async<T> is a lazily started coroutine: co_await-ing it from another coroutine transfers control symmetrically into it,
+       and back to the awaiter once it returns, so chains of coroutines neither nest stacks nor touch the queue
+    4. std::move(a).start() runs it on an engine worker and returns a promise_t settled with its result (or its exception, as a reason)
+*/
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+namespace eventual{
+
+struct promise_awaiter{
+    promise_t               p;
+    promise_t::settled_t    out;
+
+    bool await_ready(){
+        return p.try_result(out);
+    }
+    bool await_suspend(std::coroutine_handle<> h){
+        bool suspended=p.subscribe(
+            [this, h](value_t v){
+                out.fulfilled=true;
+                out.value=std::move(v);
+                h.resume();
+                return value_t();
+            },
+            [this, h](reason_t r){
+                out.fulfilled=false;
+                out.reason=std::move(r);
+                h.resume();
+                return value_t();
+            });
+        if(suspended) return true; // *this may be gone already
+        p.try_result(out);   // settled in the meantime
+        return false;
+    }
+    value_t await_resume(){
+        if(!out.fulfilled) throw out.reason;
+        return std::move(out.value);
+    }
+};
+
+inline promise_awaiter operator co_await(promise_t p){
+    return promise_awaiter{std::move(p), {}};
+}
+
+template<typename T = value_t>
+class async;
+
+namespace detail{
+
+struct async_promise_base{
+    std::coroutine_handle<>     continuation;   // whoever co_awaits this coroutine
+    std::exception_ptr          error;
+    promise_t::fulfill_func     fulfill;        // set by start(): nobody awaits, report to a promise_t
+    promise_t::reject_func      reject;
+
+    std::suspend_always initial_suspend() noexcept{
+        return {};
+    }
+    void unhandled_exception() noexcept{
+        error=std::current_exception();
+    }
+    void rethrow(){
+        if(error) std::rethrow_exception(error);
+    }
+    // settles the promise_t of a started coroutine
+    void report(value_t v){
+        if(!error){
+            fulfill(std::move(v));
+            return;
+        }
+        try{
+            std::rethrow_exception(error);
+        }catch(const reason_t& r){
+            reject(r);
+        }catch(const std::exception& e){
+            reject(reason_t(e.what()));
+        }catch(...){
+            reject(reason_t("unknown exception"));
+        }
+    }
+};
+
+template<typename Promise>
+struct final_awaiter{
+    bool await_ready() noexcept{
+        return false;
+    }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept{
+        Promise& p=h.promise();
+        if(p.continuation) return p.continuation; // symmetric transfer back to the awaiter
+        if(p.fulfill) p.report(p.result_value());
+        h.destroy();  // started and detached: nobody else owns the frame
+        return std::noop_coroutine();
+    }
+    void await_resume() noexcept{}
+};
+
+template<typename T>
+struct async_promise : async_promise_base{
+    std::optional<T> result;
+
+    async<T> get_return_object() noexcept;
+    final_awaiter<async_promise> final_suspend() noexcept{
+        return {};
+    }
+    template<typename U>
+    void return_value(U&& v){
+        result.emplace(std::forward<U>(v));
+    }
+    T take(){
+        rethrow();
+        return std::move(*result);
+    }
+    value_t result_value(){
+        return error ? value_t() : value_t(std::move(*result));
+    }
+};
+
+template<>
+struct async_promise<void> : async_promise_base{
+    async<void> get_return_object() noexcept;
+    final_awaiter<async_promise> final_suspend() noexcept{
+        return {};
+    }
+    void return_void() noexcept{}
+    void take(){
+        rethrow();
+    }
+    value_t result_value(){
+        return value_t();
+    }
+};
+
+}
+
+template<typename T>
+class async{
+public:
+    using promise_type = detail::async_promise<T>;
+    using handle_t = std::coroutine_handle<promise_type>;
+
+    async(async&& d) noexcept : h(std::exchange(d.h, {})){}
+    async& operator= (async&& d) noexcept{
+        if(this!=&d){
+            if(h) h.destroy();
+            h=std::exchange(d.h, {});
+        }
+        return *this;
+    }
+    async(const async&) = delete;
+    ~async(){
+        if(h) h.destroy();
+    }
+
+    // run it from another coroutine: control moves straight into it, and straight back once it returns
+    auto operator co_await() && noexcept{
+        struct awaiter{
+            handle_t h;
+            bool await_ready() noexcept{
+                return false;
+            }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept{
+                h.promise().continuation=awaiting;
+                return h;
+            }
+            T await_resume(){
+                return h.promise().take();
+            }
+        };
+        return awaiter{h};
+    }
+
+    // run it on an engine worker; the returned promise settles with its result (T must fit in a value_t) or its exception
+    promise_t start() &&{
+        if(!h) throw std::logic_error("async already started");
+        handle_t started=std::exchange(h, {});
+        return promise_t([started](promise_t::fulfill_func f, promise_t::reject_func r){
+            started.promise().fulfill=std::move(f);
+            started.promise().reject=std::move(r);
+            promise_engine::instance().run([started]{ started.resume(); });
+        });
+    }
+
+private:
+    friend promise_type;
+    explicit async(handle_t h) noexcept : h(h){}
+    handle_t h;
+};
+
+namespace detail{
+
+template<typename T>
+async<T> async_promise<T>::get_return_object() noexcept{
+    return async<T>(std::coroutine_handle<async_promise>::from_promise(*this));
+}
+
+inline async<void> async_promise<void>::get_return_object() noexcept{
+    return async<void>(std::coroutine_handle<async_promise>::from_promise(*this));
+}
+
+}
+
+}
+
+#endif
@@ -26,11 +26,24 @@
 #pragma once
 
 #include "threadpool.hpp"
+#include "stealing_threadpool.hpp"
+#include "timer.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 
 #define NR_THREADS 32
 
 namespace eventual{
 
+// promise_engine schedules on a work-stealing pool;
+// define EVENTUAL_LOCKED_QUEUE to fall back to the single locked queue threadpool
+#ifdef EVENTUAL_LOCKED_QUEUE
+using engine_pool_t = threadpool;
+#else
+using engine_pool_t = stealing_threadpool;
+#endif
+
 class promise_engine
 {
 public:
@@ -51,15 +64,86 @@ public:
     //         p->reject(r);
     //     });
     // }   
-    void run(std::function<void()> task_func)
+    void run(task task_func)
+    {
+        threadpool_->run(std::move(task_func));
+    }
+    // run f, a continuation, on this worker; continuations that f makes ready may then run inline (see dispatch)
+    template<typename F>
+    void run_continuation(F&& f)
+    {
+        inline_ctx& ctx=context();
+        if(ctx.active){ // already trampolined by an outer continuation
+            f();
+            return;
+        }
+        ctx.active=true;
+        ctx.depth=0;
+        ctx.start=std::chrono::steady_clock::now();
+        f();
+        while(ctx.next){
+            task t=std::move(ctx.next);
+            ctx.depth++;
+            t();
+        }
+        ctx.active=false;
+    }
+    // submit the continuation of the promise that the running continuation's result just settled:
+    // within the inline budget it runs on the same worker right after the current one returns,
+    // skipping the queue round trip; a chain of such continuations is trampolined, not nested.
+    // only for promises settled by the chain itself, after the user callback returned: a callback that settles
+    // a promise and then waits on it would wait for itself. anywhere else (user threads, providers) this is the same as run
+    void dispatch(task task_func)
+    {
+        inline_ctx& ctx=context();
+        if(ctx.active && !ctx.next && ctx.depth<max_inline_depth_.load(std::memory_order_relaxed) && 
+           std::chrono::steady_clock::now()-ctx.start<std::chrono::nanoseconds(max_inline_ns_.load(std::memory_order_relaxed))){
+            ctx.next=std::move(task_func);
+            return;
+        }
+        run(std::move(task_func)); // out of budget: yield back to the queue
+    }
+    // run task_func on the pool once when has passed; a pending timer holds no thread (see timer.hpp)
+    timer_id run_at(timer_service::clock::time_point when, task task_func)
     {
-        threadpool_->run(task_func);
+        return timers_->schedule(when, std::move(task_func));
+    }
+    timer_id run_after(timer_service::clock::duration d, task task_func)
+    {
+        return timers_->schedule_after(d, std::move(task_func));
+    }
+    // true if the timer was cancelled before it fired
+    bool cancel_timer(timer_id id)
+    {
+        return timers_->cancel(id);
+    }
+    // how many continuations may run inline in a row, and for how long; max_depth 0 queues every continuation
+    void set_inline_budget(size_t max_depth, std::chrono::nanoseconds max_time)
+    {
+        max_inline_depth_.store(max_depth, std::memory_order_relaxed);
+        max_inline_ns_.store(max_time.count(), std::memory_order_relaxed);
     }
 protected:
-    promise_engine() : threadpool_(std::make_unique<threadpool>(NR_THREADS))
+    promise_engine() : 
+    threadpool_(std::make_unique<engine_pool_t>(NR_THREADS)),
+    timers_(std::make_unique<timer_service>([this](task t){ run(std::move(t)); }))
     {}
 private:
-    std::unique_ptr<threadpool> threadpool_;
+    struct inline_ctx{
+        bool active = false;
+        size_t depth = 0;
+        std::chrono::steady_clock::time_point start;
+        task next;
+    };
+    static inline_ctx& context()
+    {
+        static thread_local inline_ctx ctx;
+        return ctx;
+    }
+    std::unique_ptr<engine_pool_t> threadpool_;
+    std::unique_ptr<timer_service> timers_;  // declared after the pool it submits to, so it stops first; see ~timer_service
+    std::atomic<size_t> max_inline_depth_{32};
+    std::atomic<int64_t> max_inline_ns_{50000};
 };
 
 
@@ -0,0 +1,91 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+// parking: block a thread on an atomic int until another thread changes it, as a futex does.
+//      parking::park(word, expected) returns once word no longer holds expected (or spuriously; callers re-check)
+//      parking::unpark_all(word) wakes every thread parked on word
+// on linux this is the futex system call itself, so an unpark without parked threads never blocks and a park never takes a lock;
+// elsewhere, or with EVENTUAL_NO_FUTEX defined, it falls back to condition variables striped by address
+
+#include <atomic>
+#include <climits>
+#if defined(__linux__) && !defined(EVENTUAL_NO_FUTEX)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#endif
+
+namespace eventual
+{
+
+namespace parking
+{
+
+#if defined(__linux__) && !defined(EVENTUAL_NO_FUTEX)
+
+inline void park(std::atomic<int>& word, int expected) noexcept{
+    syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+inline void unpark_all(std::atomic<int>& word) noexcept{
+    syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#else
+
+struct stripe_t{
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+inline stripe_t& stripe(const void* addr) noexcept{
+    static stripe_t stripes[64];
+    return stripes[(reinterpret_cast<uintptr_t>(addr)>>4)%64];
+}
+
+inline void park(std::atomic<int>& word, int expected) noexcept{
+    stripe_t& s=stripe(&word);
+    std::unique_lock<std::mutex> lck(s.mtx);
+    while(word.load()==expected) s.cv.wait(lck);
+}
+
+// taking the stripe lock orders this unpark after any park that has checked the word but not started waiting yet
+inline void unpark_all(std::atomic<int>& word) noexcept{
+    stripe_t& s=stripe(&word);
+    { std::lock_guard<std::mutex> lck(s.mtx); }
+    s.cv.notify_all();
+}
+
+#endif
+
+}
+
+}
@@ -0,0 +1,228 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+/*
+pool: thread-caching size-class allocator for small, short-lived objects (promise metas, continuation nodes)
+
+    1. every thread owns a cache with one free list per size class; allocating and freeing on the owner thread touches no atomics but the counters
+    2. a block freed on another thread is pushed onto its owner cache's lock-free remote list,
+       which the owner takes back in one exchange when its local list runs dry
+    3. blocks are carved from slabs that are never given back to the system; a thread that exits leaves its cache to the next new thread
+    4. requests larger than the biggest size class go straight to ::operator new
+*/
+
+namespace eventual{
+
+class pool{
+public:
+    static constexpr size_t granularity = 32;
+    static constexpr size_t nr_classes = 16;      // blocks of 32, 64, ... 512 bytes, header included
+    static constexpr size_t blocks_per_slab = 64;
+
+    struct stats_t{
+        uint64_t allocations = 0;     // served by the pool
+        uint64_t deallocations = 0;
+        uint64_t remote_frees = 0;    // freed by a thread that does not own the block (included in deallocations)
+        uint64_t slabs = 0;           // slab allocations from the system
+        uint64_t large = 0;           // too big for the pool, went to ::operator new
+    };
+
+    static void* allocate(size_t n){
+        size_t total=n+sizeof(header_t);
+        if(total>granularity*nr_classes){
+            header_t* h=static_cast<header_t*>(::operator new(total));
+            h->owner=nullptr;
+            h->cls=0;
+            bump(local_cache()->large);
+            return h+1;
+        }
+        size_t cls=(total-1)/granularity;
+        cache_t* c=local_cache();
+        block_t* b=c->local[cls];
+        if(b==nullptr){
+            b=c->remote[cls].exchange(nullptr, std::memory_order_acquire);
+            if(b==nullptr) b=refill(c, cls);
+        }
+        c->local[cls]=b->next;
+        bump(c->allocations);
+        header_t* h=reinterpret_cast<header_t*>(b);
+        h->owner=c;
+        h->cls=cls;
+        return h+1;
+    }
+
+    static void deallocate(void* p) noexcept{
+        if(p==nullptr) return;
+        header_t* h=static_cast<header_t*>(p)-1;
+        cache_t* owner=h->owner;
+        if(owner==nullptr){
+            ::operator delete(h);
+            return;
+        }
+        size_t cls=h->cls;
+        block_t* b=reinterpret_cast<block_t*>(h);
+        cache_t* c=tls_cache();
+        if(c==owner){
+            b->next=c->local[cls];
+            c->local[cls]=b;
+            bump(c->local_frees);
+            return;
+        }
+        block_t* head=owner->remote[cls].load(std::memory_order_relaxed);
+        do{
+            b->next=head;
+        }while(!owner->remote[cls].compare_exchange_weak(head, b, std::memory_order_release, std::memory_order_relaxed));
+        // the freeing thread may not have a cache at all; the owner's cache line is hot here anyway
+        owner->remote_frees.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // totals over every cache ever created
+    static stats_t stats() noexcept{
+        stats_t s;
+        for(cache_t* c=registry().load(std::memory_order_acquire); c!=nullptr; c=c->next_cache){
+            s.allocations+=c->allocations.load(std::memory_order_relaxed);
+            s.deallocations+=c->local_frees.load(std::memory_order_relaxed)+c->remote_frees.load(std::memory_order_relaxed);
+            s.remote_frees+=c->remote_frees.load(std::memory_order_relaxed);
+            s.slabs+=c->slabs.load(std::memory_order_relaxed);
+            s.large+=c->large.load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+
+private:
+    struct cache_t;
+    struct alignas(16) header_t{
+        cache_t* owner;
+        size_t   cls;
+    };
+    // a free block reuses its header for the link
+    struct block_t{
+        block_t* next;
+    };
+    struct cache_t{
+        block_t*                local[nr_classes] = {};
+        std::atomic<block_t*>   remote[nr_classes] = {};
+        std::atomic<bool>       in_use{true};
+        cache_t*                next_cache = nullptr;
+        // written by the owner only (but remote_frees); atomics so that stats() may read them
+        std::atomic<uint64_t>   allocations{0};
+        std::atomic<uint64_t>   local_frees{0};
+        std::atomic<uint64_t>   remote_frees{0};
+        std::atomic<uint64_t>   slabs{0};
+        std::atomic<uint64_t>   large{0};
+    };
+
+    static void bump(std::atomic<uint64_t>& counter) noexcept{
+        counter.store(counter.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+    }
+
+    static block_t* refill(cache_t* c, size_t cls){
+        size_t size=(cls+1)*granularity;
+        char* slab=static_cast<char*>(::operator new(size*blocks_per_slab));
+        bump(c->slabs);
+        block_t* head=nullptr;
+        for(size_t i=blocks_per_slab; i>0; i--){
+            block_t* b=reinterpret_cast<block_t*>(slab+(i-1)*size);
+            b->next=head;
+            head=b;
+        }
+        return head;
+    }
+
+    static std::atomic<cache_t*>& registry() noexcept{
+        static std::atomic<cache_t*> head{nullptr};
+        return head;
+    }
+
+    // adopt a cache left behind by an exited thread, or register a new one
+    static cache_t* acquire_cache(){
+        for(cache_t* c=registry().load(std::memory_order_acquire); c!=nullptr; c=c->next_cache){
+            bool expected=false;
+            if(c->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) return c;
+        }
+        cache_t* c=new cache_t;
+        cache_t* head=registry().load(std::memory_order_relaxed);
+        do{
+            c->next_cache=head;
+        }while(!registry().compare_exchange_weak(head, c, std::memory_order_release, std::memory_order_relaxed));
+        return c;
+    }
+
+    // trivially destructible, so it is still readable while other thread_locals are being destroyed
+    static cache_t*& tls_cache() noexcept{
+        static thread_local cache_t* c=nullptr;
+        return c;
+    }
+
+    struct releaser_t{
+        ~releaser_t(){
+            cache_t*& c=tls_cache();
+            if(c!=nullptr) c->in_use.store(false, std::memory_order_release);
+            c=nullptr;
+        }
+    };
+
+    static cache_t* local_cache(){
+        cache_t*& c=tls_cache();
+        if(c==nullptr){
+            c=acquire_cache();
+            static thread_local releaser_t releaser;
+            (void)releaser;
+        }
+        return c;
+    }
+};
+
+// std allocator on top of pool, for std::allocate_shared
+template<typename T>
+struct pool_allocator{
+    using value_type = T;
+    pool_allocator() noexcept{}
+    template<typename U>
+    pool_allocator(const pool_allocator<U>&) noexcept{}
+    T* allocate(size_t n){
+        return static_cast<T*>(pool::allocate(n*sizeof(T)));
+    }
+    void deallocate(T* p, size_t) noexcept{
+        pool::deallocate(p);
+    }
+    template<typename U>
+    bool operator== (const pool_allocator<U>&) const noexcept{
+        return true;
+    }
+    template<typename U>
+    bool operator!= (const pool_allocator<U>&) const noexcept{
+        return false;
+    }
+};
+
+}
@@ -24,188 +24,568 @@
  */
 
 #include "promise.h"
-#include <list>
+#include <atomic>
+#include <memory>
+#include "pool.hpp"
 
 namespace eventual{
 
+// a pending continuation; it is an intrusive node of promise_meta_t's lock-free stack
 struct promise_t::then_t{
     then_t( on_fullfilled_func          on_fullfilled, 
             on_rejected_func            on_rejected, 
             std::shared_ptr<promise_meta_t> p) : 
-            on_fullfilled_(on_fullfilled), 
-            on_rejected_(on_rejected), 
-            promise_(p)
+            on_fullfilled_(std::move(on_fullfilled)), 
+            on_rejected_(std::move(on_rejected)), 
+            promise_(std::move(p))
+    {}
+    // a combinator's input instead: no user callbacks, just bookkeeping
+    then_t(std::shared_ptr<join_t> join, size_t index) : join_(std::move(join)), index_(index)
     {}
     on_fullfilled_func                  on_fullfilled_;
     on_rejected_func                    on_rejected_;
     std::shared_ptr<promise_meta_t>     promise_;
+    std::shared_ptr<join_t>             join_;
+    size_t                              index_ = 0;
+    then_t*                             next = nullptr;
+
+    static void* operator new(size_t n){
+        return pool::allocate(n);
+    }
+    static void operator delete(void* p) noexcept{
+        pool::deallocate(p);
+    }
 };
 
+
+/*
+join_t: shared state of all / any / race / all_settled
+
+    1. remaining counts down the inputs that still matter; results go to slots preallocated per input, so inputs never contend on a lock
+    2. whoever flips done settles out and is the only one to touch out (and release it) afterwards; later inputs are ignored
+*/
+struct promise_t::join_t{
+    join_t(join_kind kind, size_t n, std::shared_ptr<promise_meta_t> out) : 
+        kind(kind), remaining(n), out(std::move(out))
+    {
+        if(kind==join_kind::all) values.resize(n);
+        else if(kind==join_kind::all_settled) settled.resize(n);
+    }
+    void fulfilled(size_t i, const value_t& v){
+        switch(kind){
+        case join_kind::all:
+            values[i]=v;
+            if(remaining.fetch_sub(1, std::memory_order_acq_rel)==1 && win()) finish_fulfilled(value_t(std::move(values)));
+            break;
+        case join_kind::any:
+        case join_kind::race:
+            if(win()) finish_fulfilled(v);
+            break;
+        case join_kind::all_settled:
+            settled[i].fulfilled=true;
+            settled[i].value=v;
+            if(remaining.fetch_sub(1, std::memory_order_acq_rel)==1 && win()) finish_fulfilled(value_t(std::move(settled)));
+            break;
+        }
+    }
+    void rejected(size_t i, const reason_t& r){
+        switch(kind){
+        case join_kind::all:
+        case join_kind::race:
+            if(win()) finish_rejected(r);
+            break;
+        case join_kind::any:
+            if(remaining.fetch_sub(1, std::memory_order_acq_rel)==1 && win()) 
+                finish_rejected(reason_t("all promises were rejected, the last one with: ")+r);
+            break;
+        case join_kind::all_settled:
+            settled[i].fulfilled=false;
+            settled[i].reason=r;
+            if(remaining.fetch_sub(1, std::memory_order_acq_rel)==1 && win()) finish_fulfilled(value_t(std::move(settled)));
+            break;
+        }
+    }
+    bool win() noexcept{
+        return !done.exchange(true, std::memory_order_acq_rel);
+    }
+    // the output no longer needs to be reachable from the losers' nodes
+    void finish_fulfilled(value_t v);
+    void finish_rejected(reason_t r);
+
+    const join_kind                     kind;
+    std::atomic<size_t>                 remaining;
+    std::atomic<bool>                   done{false};
+    std::shared_ptr<promise_meta_t>     out;
+    std::vector<value_t>                values;    // all
+    std::vector<settled_t>              settled;   // all_settled
+};
+
+/*
+promise_meta_t is lock-free:
+
+    1. state only moves forward: pending -> settling -> fulfilled/rejected; 
+       whoever wins the pending -> settling CAS writes value/reason, then publishes the final state
+    2. pending continuations form a Treiber stack headed by thens; then() on a pending promise is a single CAS push
+    3. the settler swaps the stack head for closed() and dispatches what it took, so every continuation runs exactly once;
+       a then() that finds closed() knows value/reason are already published and dispatches itself
+*/
 class promise_t::promise_meta_t{
 private:
-    state_t                             state = pending;
-    std::mutex                          mtx; 
+    std::atomic<int>                    state{pending};
     // please note that these are BFS direct successors of this promise
     // don't confused them with DFS then-chained successors
-    std::list<then_t>                   thens;  
+    std::atomic<then_t*>                thens{nullptr};  
     value_t                             value;    // default nullptr
     reason_t                            reason;   // default ""
+    // inherited by then successors; a cancelled promise skips its continuations
+    cancellation_token                  token;
+    // inherited by then successors; current while their callbacks run
+    std::shared_ptr<arena>              arena_;
+
+    // marks a settled promise's stack; never dereferenced
+    static then_t* closed() noexcept{
+        static char tag;
+        return reinterpret_cast<then_t*>(&tag);
+    }
+
+    bool try_settle() noexcept{
+        int expected=pending;
+        return state.compare_exchange_strong(expected, settling, std::memory_order_acquire);
+    }
+
+    // runs a continuation of this (already settled) promise in the background; 
+    // inline may let the engine run it on this worker right after the current continuation;
+    // take hands it the value itself rather than a copy, when it is known to be the only consumer
+    void dispatch(then_t* t, bool inline_=false, bool take=false){
+        std::unique_ptr<then_t> node(t);
+        bool is_fulfilled=state.load(std::memory_order_acquire)==fulfilled;
+        if(node->join_){ // cheap enough to do right here
+            if(is_fulfilled) node->join_->fulfilled(node->index_, value);
+            else node->join_->rejected(node->index_, reason);
+            return;
+        }
+        if(node->promise_==nullptr){ // a subscriber: no successor to resolve
+            if(is_fulfilled){
+                submit([node=std::move(node),v=consume(take)]() mutable{
+                    promise_engine::instance().run_continuation([&]{ node->on_fullfilled_(std::move(v)); });
+                }, inline_);
+            }else{
+                submit([node=std::move(node),r=reason]() mutable{
+                    promise_engine::instance().run_continuation([&]{ node->on_rejected_(std::move(r)); });
+                }, inline_);
+            }
+            return;
+        }
+        if(is_fulfilled){
+            submit([node=std::move(node),v=consume(take)]() mutable{
+                promise_engine::instance().run_continuation([&]{
+                    trigger_on_fulfill(node->promise_, node->on_fullfilled_, std::move(v));
+                });
+            }, inline_);
+        }else{
+            submit([node=std::move(node),r=reason]() mutable{
+                promise_engine::instance().run_continuation([&]{
+                    trigger_on_reject(node->promise_, node->on_rejected_, std::move(r));
+                });
+            }, inline_);
+        }
+    }
+    value_t consume(bool take){
+        if(take) return std::move(value);
+        return value;
+    }
+    static void submit(task t, bool inline_){
+        if(inline_) promise_engine::instance().dispatch(std::move(t));
+        else promise_engine::instance().run(std::move(t));
+    }
+
+    // close the stack and dispatch its continuations in the order they were added;
+    // sole_owner: the settler holds the only reference to this promise, so nobody can add continuations later;
+    // chained: settled by the chain itself once a continuation returned (see resolve), never by user code,
+    // which may go on to wait for what it settled: only then may a continuation run inline
+    void drain(bool sole_owner=false, bool chained=false){
+        then_t* head=thens.exchange(closed(), std::memory_order_acq_rel);
+        then_t* ordered=nullptr;
+        while(head!=nullptr){
+            then_t* next=head->next;
+            head->next=ordered;
+            ordered=head;
+            head=next;
+        }
+        // a lone continuation of a promise nobody else can reach takes the value as it is: a unique value stays unique
+        if(sole_owner && ordered!=nullptr && ordered->next==nullptr && !ordered->join_){
+            dispatch(ordered, chained, true);
+            return;
+        }
+        value.share();
+        // fan-out goes to the queue; the last one may continue the chain on this worker
+        while(ordered!=nullptr){
+            then_t* next=ordered->next;
+            dispatch(ordered, chained && next==nullptr);
+            ordered=next;
+        }
+    }
+
+    // false if the promise has settled; the node is still ours then
+    bool push(then_t* t) noexcept{
+        then_t* head=thens.load(std::memory_order_acquire);
+        while(head!=closed()){
+            t->next=head;
+            if(thens.compare_exchange_weak(head, t, std::memory_order_release, std::memory_order_acquire)) 
+                return true;
+        }
+        return false;
+    }
 
 public:
     // initially pending promise
     promise_meta_t(){} 
     // create a fulfilled promise 
-    promise_meta_t(value_t v): state(fulfilled), value(v){}
+    promise_meta_t(value_t v): state(fulfilled), thens(closed()), value(std::move(v)){
+        value.share();
+    }
     // create a rejected promise
-    promise_meta_t(reason_t r): state(rejected), reason(r){}
-
-    void fulfill(value_t v){
-        std::lock_guard<std::mutex> lk(mtx);
-        if(state!=pending) return;
-        state=fulfilled;
-        value=v;
-        for(auto& t : thens ){   
-            promise_engine::instance().run([t,v]{
-                trigger_on_fulfill(t.promise_, t.on_fullfilled_,v);
-            });
+    promise_meta_t(reason_t r): state(rejected), thens(closed()), reason(std::move(r)){}
+    // a promise that never settles still owns its continuations
+    ~promise_meta_t(){
+        then_t* head=thens.load(std::memory_order_acquire);
+        while(head!=nullptr && head!=closed()){
+            then_t* next=head->next;
+            delete head;
+            head=next;
         }
     }
 
-    void reject(reason_t r){
-        std::lock_guard<std::mutex> lk(mtx);
-        if(state!=pending) return;
-        state=rejected;
-        reason=r;
-        for(auto& t : thens ){   
-            promise_engine::instance().run([t,r]{
-                trigger_on_reject(t.promise_, t.on_rejected_, r);
-            });
-        }
+    // sole_owner, chained: see drain; without sole_owner a unique value is shared before anyone else may read it
+    void fulfill(value_t v, bool sole_owner=false, bool chained=false){
+        if(!try_settle()) return;
+        value=std::move(v);
+        if(!sole_owner) value.share();
+        state.store(fulfilled, std::memory_order_release);
+        drain(sole_owner, chained);
+    }
+
+    void reject(reason_t r, bool chained=false){
+        if(!try_settle()) return;
+        reason=std::move(r);
+        state.store(rejected, std::memory_order_release);
+        drain(false, chained);
     }
 
     std::shared_ptr<promise_meta_t> then(on_fullfilled_func f, on_rejected_func r)
     {
-        std::unique_lock<std::mutex> lk(mtx);
-        auto promise_=std::make_shared<promise_meta_t>();
-        if(state==pending) 
-            thens.emplace_back(f,r,promise_);
-        else if(state==rejected) 
-            promise_engine::instance().run([r,promise_,cur_r=reason]{
-                trigger_on_reject(promise_, r, cur_r);
-            });
-        else
-            promise_engine::instance().run([f,promise_,cur_v=value]{
-                trigger_on_fulfill(promise_, f, cur_v);
-            });
+        auto promise_=make_meta();
+        promise_->token=token;
+        promise_->arena_=arena_;
+        then_t* t=new then_t(std::move(f), std::move(r), promise_);
+        if(!push(t)) dispatch(t);
         return promise_;
     }
 
-    void adopted_by(std::shared_ptr<promise_meta_t> p)
+    bool cancelled() const noexcept{
+        return token.is_cancelled();
+    }
+
+    void cancel_with(cancellation_token t) noexcept{
+        token=std::move(t);
+    }
+
+    const cancellation_token& cancellation() const noexcept{
+        return token;
+    }
+
+    void allocate_from(std::shared_ptr<arena> a) noexcept{
+        arena_=std::move(a);
+    }
+
+    const std::shared_ptr<arena>& allocation_arena() const noexcept{
+        return arena_;
+    }
+
+    bool try_result(settled_t& out) const
     {
-        std::lock_guard<std::mutex> lk(mtx);
-        if(state==fulfilled) p->fulfill(value); 
-        else if(state==rejected) p->reject(reason);
-        else{
-            thens.emplace_back(nullptr, nullptr, p);
+        int s=state.load(std::memory_order_acquire);
+        if(s==fulfilled){
+            out.fulfilled=true;
+            out.value=value;
+        }else if(s==rejected){
+            out.fulfilled=false;
+            out.reason=reason;
         }
+        return s==fulfilled || s==rejected;
+    }
+
+    bool subscribe(on_fullfilled_func f, on_rejected_func r)
+    {
+        then_t* t=new then_t(std::move(f), std::move(r), nullptr);
+        if(push(t)) return true;
+        delete t;
+        return false;
+    }
+
+    void joined_by(std::shared_ptr<join_t> join, size_t index)
+    {
+        then_t* t=new then_t(std::move(join), index);
+        if(!push(t)) dispatch(t);
+    }
+
+    void adopted_by(std::shared_ptr<promise_meta_t> p)
+    {
+        then_t* t=new then_t(nullptr, nullptr, p);
+        if(push(t)) return;
+        delete t;
+        if(state.load(std::memory_order_acquire)==fulfilled) p->fulfill(value, false, true); 
+        else p->reject(reason, true);
     }
 };
 
+void promise_t::join_t::finish_fulfilled(value_t v)
+{
+    std::shared_ptr<promise_meta_t> p=std::move(out);
+    p->fulfill(std::move(v));
+}
+
+void promise_t::join_t::finish_rejected(reason_t r)
+{
+    std::shared_ptr<promise_meta_t> p=std::move(out);
+    p->reject(std::move(r));
+}
+
+// metas and their control blocks come from the thread-caching pool
+template<typename... Args>
+std::shared_ptr<promise_t::promise_meta_t> promise_t::make_meta(Args&&... args)
+{
+    return std::allocate_shared<promise_meta_t>(pool_allocator<promise_meta_t>(), std::forward<Args>(args)...);
+}
 
 // promise resolution procedure: If x is a promise, it attempts to make promise adopt the state of x. 
-void promise_t::resolve(std::shared_ptr<promise_meta_t> p, value_t value_x)
+void promise_t::resolve(const std::shared_ptr<promise_meta_t>& p, value_t value_x)
 {
-    if( value_x.has_same_type(typeid(promise_t)) )
+    // a promise_t is never stored inline, so this is one pointer test for inline values and one type_id compare otherwise
+    if( const promise_t* adopted=value_x.get_if<promise_t>() )
     {
-        std::shared_ptr<promise_meta_t> x= value_x.data<promise_t>().meta;
+        std::shared_ptr<promise_meta_t> x= adopted->meta;
         if(x==p){
-            p->reject(reason_t("It's illogical for a promise to adopt the state of itself!"));
+            p->reject(reason_t("It's illogical for a promise to adopt the state of itself!"), true);
             return;
         }
-        x->adopted_by(p);//will block if x is now being fulfilled/rejected
+        x->adopted_by(p); // never blocks: one CAS push onto x's stack, or p settles right here if x already has
     }else{
-        p->fulfill(value_x);
+        // nobody else holding p (the usual case for a link in the middle of a chain) lets a unique value pass on unshared
+        p->fulfill(std::move(value_x), p.use_count()==1, true);
     }
 }
 
 promise_t promise_t::then(on_fullfilled_func f, on_rejected_func r)
 {
-    return promise_t(meta->then(f,r));
+    return promise_t(meta->then(std::move(f),std::move(r)));
+}
+
+bool promise_t::try_result(settled_t& out) const
+{
+    return meta->try_result(out);
+}
+
+bool promise_t::subscribe(on_fullfilled_func f, on_rejected_func r) const
+{
+    return meta->subscribe(std::move(f), std::move(r));
 }
 
 
 // create a initial promise 
 promise_t::promise_t(init_func init) : 
-meta(std::make_shared<promise_meta_t>())
+promise_t(std::move(init), cancellation_token(), nullptr)
+{}
+
+promise_t::promise_t(init_func init, cancellation_token token) : 
+promise_t(std::move(init), std::move(token), nullptr)
+{}
+
+promise_t::promise_t(init_func init, std::shared_ptr<arena> a) : 
+promise_t(std::move(init), cancellation_token(), std::move(a))
+{}
+
+promise_t::promise_t(init_func init, cancellation_token token, std::shared_ptr<arena> a) : 
+meta(make_meta())
 {
     if(init==nullptr) throw std::runtime_error("promise init_func should not be nullptr!");
+    meta->cancel_with(std::move(token));
+    meta->allocate_from(std::move(a));
+    if(meta->cancelled()){
+        meta->reject(cancelled_reason());
+        return;
+    }
+    // the meta, not this: providers may settle the promise after this promise_t object is gone
+    std::shared_ptr<promise_meta_t> m=meta;
+    arena::scope in(meta->allocation_arena());
     init( 
-        [this](value_t v){ 
-            meta->fulfill(v);
+        [m](value_t v){ 
+            m->fulfill(std::move(v));
         },
-        [this](reason_t r){ 
-            meta->reject(r);
+        [m](reason_t r){ 
+            m->reject(std::move(r));
         }
     );        
 }
 
-void promise_t::trigger_on_reject(std::shared_ptr<promise_meta_t> promise_, on_rejected_func on_rejected_, reason_t r)
+void promise_t::trigger_on_reject(const std::shared_ptr<promise_meta_t>& promise_, const on_rejected_func& on_rejected_, reason_t r)
 {
+    if(promise_->cancelled()) // dropped before it runs; the rejection cascades down the chain
+    {
+        promise_->reject(cancelled_reason(), true);
+        return;
+    }
     if(on_rejected_==nullptr)
     {
-        promise_->reject(r);
+        promise_->reject(std::move(r), true);
         return;
     }
     value_t x;
+    arena::scope in(promise_->allocation_arena());
     try{
         x = on_rejected_(r);
     }catch(const reason_t& reason){
-        promise_->reject(reason);
+        promise_->reject(reason, true);
         return;
     }catch(const std::exception& e){
         reason_t reason(e.what());
-        promise_->reject(reason);
+        promise_->reject(reason, true);
         return;
     }catch(...){
-        promise_->reject(reason_t("unknown reason"));
+        promise_->reject(reason_t("unknown reason"), true);
         return;
     }
-    resolve(promise_,x);
+    resolve(promise_,std::move(x));
 }
 
 
-void promise_t::trigger_on_fulfill(std::shared_ptr<promise_meta_t> promise_, on_fullfilled_func on_fullfilled_, value_t v)
+void promise_t::trigger_on_fulfill(const std::shared_ptr<promise_meta_t>& promise_, const on_fullfilled_func& on_fullfilled_, value_t v)
 {
+    if(promise_->cancelled()) // dropped before it runs; the rejection cascades down the chain
+    {
+        promise_->reject(cancelled_reason(), true);
+        return;
+    }
     if(on_fullfilled_==nullptr)
     {
-        promise_->fulfill(v);
+        promise_->fulfill(std::move(v), false, true);
         return;
     }
     value_t x;
+    arena::scope in(promise_->allocation_arena());
     try{
-        x = on_fullfilled_(v); // execute user code
+        x = on_fullfilled_(std::move(v)); // execute user code
     }catch(const reason_t& reason){
-        promise_->reject(reason);
+        promise_->reject(reason, true);
         return;
     }catch(const std::exception& e){
         reason_t reason(e.what());
-        promise_->reject(reason);
+        promise_->reject(reason, true);
         return;
     }catch(...){
-        promise_->reject(reason_t("unknown reason"));
+        promise_->reject(reason_t("unknown reason"), true);
         return;
     }
-    resolve(promise_,x);
+    resolve(promise_,std::move(x));
+}
+
+const reason_t& promise_t::cancelled_reason()
+{
+    static const reason_t reason("promise cancelled");
+    return reason;
+}
+
+const reason_t& promise_t::timeout_reason()
+{
+    static const reason_t reason("promise timed out");
+    return reason;
+}
+
+promise_t promise_t::delay(std::chrono::milliseconds d, value_t v)
+{
+    auto out=make_meta();
+    promise_engine::instance().run_after(d, [out, v]() mutable{
+        resolve(out, std::move(v));
+    });
+    return promise_t(out);
+}
+
+promise_t promise_t::timeout(std::chrono::milliseconds d) const
+{
+    auto out=make_meta();
+    out->cancel_with(meta->cancellation());
+    out->allocate_from(meta->allocation_arena());
+    // whichever settles out first wins; the loser's fulfill/reject is a no-op
+    timer_id id=promise_engine::instance().run_after(d, [out]{
+        out->reject(timeout_reason());
+    });
+    // a subscriber, not a then: a then node would inherit the token and be skipped once this promise is cancelled,
+    // leaving out to time out instead of reporting the cancellation
+    on_fullfilled_func f=[out, id](value_t v){
+        promise_engine::instance().cancel_timer(id);
+        out->fulfill(std::move(v));
+        return value_t();
+    };
+    on_rejected_func r=[out, id](reason_t r){
+        promise_engine::instance().cancel_timer(id);
+        out->reject(std::move(r));
+        return value_t();
+    };
+    if(!meta->subscribe(f, r)){
+        settled_t result;
+        meta->try_result(result);
+        if(result.fulfilled) f(std::move(result.value));
+        else r(std::move(result.reason));
+    }
+    return promise_t(out);
 }
 
 promise_t promise_t::create_fulfilled_promise(value_t v)
 {
-    return std::make_shared<promise_meta_t>(v);
+    return make_meta(std::move(v));
 }
 
 promise_t promise_t::create_rejected_promise(reason_t r)
 {
-    return std::make_shared<promise_meta_t>(r);
+    return make_meta(std::move(r));
+}
+
+
+promise_t promise_t::join(join_kind kind, const std::vector<promise_t>& promises)
+{
+    auto out=make_meta();
+    if(promises.empty()){
+        if(kind==join_kind::all) out->fulfill(value_t(std::vector<value_t>()));
+        else if(kind==join_kind::all_settled) out->fulfill(value_t(std::vector<settled_t>()));
+        else if(kind==join_kind::any) out->reject(reason_t("all promises were rejected"));
+        // race: an empty race never settles
+        return promise_t(out);
+    }
+    auto join=std::allocate_shared<join_t>(pool_allocator<join_t>(), kind, promises.size(), out);
+    for(size_t i=0; i<promises.size(); i++){
+        promises[i].meta->joined_by(join, i);
+    }
+    return promise_t(out);
+}
+
+promise_t promise_t::all(const std::vector<promise_t>& promises)
+{
+    return join(join_kind::all, promises);
+}
+
+promise_t promise_t::any(const std::vector<promise_t>& promises)
+{
+    return join(join_kind::any, promises);
+}
+
+promise_t promise_t::race(const std::vector<promise_t>& promises)
+{
+    return join(join_kind::race, promises);
+}
+
+promise_t promise_t::all_settled(const std::vector<promise_t>& promises)
+{
+    return join(join_kind::all_settled, promises);
 }
 
 }
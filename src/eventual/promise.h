@@ -27,6 +27,10 @@
 
 #include "engine.hpp"
 #include "zero_copy_value.hpp"
+#include "cancellation.hpp"
+#include "arena.hpp"
+#include <chrono>
+#include <vector>
 
 /*
 Eventual: A Promise-like Async Programming Library
@@ -72,9 +76,51 @@ public:
     static promise_t create_rejected_promise(reason_t r);
     // [interface 1] create a initial promise
     promise_t(init_func);
+    // [interface 1] create a initial promise that stops once token is cancelled:
+    // init is skipped if it already is, and every then successor inherits the token;
+    // continuations that have not started yet (queued ones included) are skipped and their promises rejected with cancelled_reason()
+    promise_t(init_func, cancellation_token token);
+    // [interface 1] create a initial promise whose chain allocates from a (see arena.hpp):
+    // init and every callback of the chain run with a current, so the values they create live in it;
+    // the arena is released once the last promise of the chain and the last of those values are gone
+    promise_t(init_func, std::shared_ptr<arena> a);
+    promise_t(init_func, cancellation_token token, std::shared_ptr<arena> a);
+    // the reason of a promise rejected by cancellation
+    static const reason_t& cancelled_reason();
     // [interface 2] what to do next 
     promise_t then(on_fullfilled_func f, on_rejected_func r);
 
+    // fulfilled with v once d has elapsed; no thread sleeps meanwhile, the engine's timer wheel fires it
+    static promise_t delay(std::chrono::milliseconds d, value_t v = value_t());
+    // settled like this promise, or rejected with timeout_reason() if d elapses first
+    promise_t timeout(std::chrono::milliseconds d) const;
+    // the reason of a promise rejected by timeout
+    static const reason_t& timeout_reason();
+
+    // outcome of one input of all_settled
+    struct settled_t{
+        bool        fulfilled;
+        value_t     value;    // if fulfilled
+        reason_t    reason;   // if rejected
+    };
+    // combinators: every input costs one pooled node and one atomic decrement, no locks
+    // fulfilled with a std::vector<value_t> in input order, or rejected with the first rejection
+    static promise_t all(const std::vector<promise_t>& promises);
+    // fulfilled with the first fulfilled value, or rejected once every input is rejected
+    static promise_t any(const std::vector<promise_t>& promises);
+    // settled like the first input that settles
+    static promise_t race(const std::vector<promise_t>& promises);
+    // fulfilled with a std::vector<settled_t> in input order once every input has settled
+    static promise_t all_settled(const std::vector<promise_t>& promises);
+
+    // [low level, used by co_await, see coroutine.hpp]
+    // the outcome if this promise has settled already; false while it is pending
+    bool try_result(settled_t& out) const;
+    // once this promise settles, call f or r exactly once on an engine worker, trampolined like a then continuation;
+    // unlike then, no successor promise is made, return values are ignored and cancellation does not apply.
+    // false if it has settled already: neither is called then, use try_result
+    bool subscribe(on_fullfilled_func f, on_rejected_func r) const;
+
     promise_t(const promise_t& d) : meta(d.meta){}
     promise_t& operator= (promise_t&&d) noexcept{
         meta.swap(d.meta);
@@ -93,6 +139,7 @@ public:
 
 private:
     struct then_t;  
+    struct join_t;  // shared state of a combinator
     class promise_meta_t; // impl class
 
     promise_t(std::shared_ptr<promise_meta_t> m):
@@ -100,13 +147,20 @@ private:
     enum state_t : int{ 
         pending = 0,
         fulfilled = 1,
-        rejected =2
+        rejected =2,
+        settling =3  // being fulfilled/rejected; value or reason not published yet
     };
     std::shared_ptr<promise_meta_t> meta;
+    // metas come from the thread-caching pool (pool.hpp)
+    template<typename... Args>
+    static std::shared_ptr<promise_meta_t> make_meta(Args&&... args);
+    // which combinator a join_t implements
+    enum class join_kind{ all, any, race, all_settled };
+    static promise_t join(join_kind kind, const std::vector<promise_t>& promises);
     // promise resolution procedure.
-    static void resolve(std::shared_ptr<promise_meta_t> p, value_t x);
-    static void trigger_on_reject(std::shared_ptr<promise_meta_t> promise_, on_rejected_func on_rejected_, reason_t r);
-    static void trigger_on_fulfill(std::shared_ptr<promise_meta_t> promise_, on_fullfilled_func on_fullfilled_, value_t v);
+    static void resolve(const std::shared_ptr<promise_meta_t>& p, value_t x);
+    static void trigger_on_reject(const std::shared_ptr<promise_meta_t>& promise_, const on_rejected_func& on_rejected_, reason_t r);
+    static void trigger_on_fulfill(const std::shared_ptr<promise_meta_t>& promise_, const on_fullfilled_func& on_fullfilled_, value_t v);
 
 
 };
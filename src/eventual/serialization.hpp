@@ -0,0 +1,177 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "zero_copy_value.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+/*
+Binary serialization of zero_copy_value, e.g. to hand promise results to another process
+
+    1. type_registry maps registered types to stable ids chosen by the application; every process registers the same ids.
+       the encoding is native (byte order, layout), so it is meant for processes on the same machine
+    2. a record is a record_header (id, payload size) followed by the payload, padded to record_align bytes,
+       so records can be laid out back to back and every payload stays aligned
+    3. trivially-copyable types need no code: add<T>(id) copies their bytes straight into the caller's buffer
+    4. deserialize with an owner (the mapping, the shared memory segment, ...) references the buffer: the value borrows
+       the payload and keeps the owner alive (see zero_copy_value::borrow); without an owner the payload is copied.
+       payloads small enough to be stored inline are always copied
+    5. register every type at startup, before the first serialize or deserialize; lookups are not synchronized with add
+*/
+
+namespace eventual{
+
+struct record_header{
+    uint32_t type;      // the stable id; 0 is the empty value
+    uint32_t reserved;
+    uint64_t size;      // payload bytes that follow, without padding
+};
+
+class type_registry{
+public:
+    // writes the payload of v to out if it fits in cap bytes; returns the payload size either way
+    using serialize_func = std::function<size_t(const zero_copy_value& v, void* out, size_t cap)>;
+    // rebuilds a value from size payload bytes; a non-null owner keeps data alive, so the value may borrow from it
+    using deserialize_func = std::function<zero_copy_value(const void* data, size_t size, const std::shared_ptr<const void>& owner)>;
+
+    static constexpr size_t header_size = sizeof(record_header);
+    static constexpr size_t record_align = alignof(uint64_t);
+
+    static type_registry& instance()
+    {
+        static type_registry instance;
+        return instance;
+    }
+    // a trivially-copyable T: its bytes are its encoding
+    template<typename T>
+    void add(uint32_t id)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "T needs its own serialize and deserialize functions");
+        add(type_id<T>(), id,
+            [](const zero_copy_value& v, void* out, size_t cap)->size_t{
+                if(cap>=sizeof(T)) std::memcpy(out, v.get_if<T>(), sizeof(T));
+                return sizeof(T);
+            },
+            [](const void* data, size_t size, const std::shared_ptr<const void>& owner)->zero_copy_value{
+                if(size!=sizeof(T)) throw std::runtime_error("record size does not match the registered type");
+                if(owner!=nullptr && !zero_copy_value::stores_inline<T>() && reinterpret_cast<uintptr_t>(data)%alignof(T)==0){
+                    return zero_copy_value::borrow(static_cast<const T*>(data), owner);
+                }
+                typename std::aligned_storage<sizeof(T), alignof(T)>::type tmp;
+                std::memcpy(&tmp, data, sizeof(T));
+                return zero_copy_value(*reinterpret_cast<T*>(&tmp));
+            });
+    }
+    // any T, with size_t serialize(const T&, void* out, size_t cap) and zero_copy_value deserialize(data, size, owner) as above
+    template<typename T, typename S, typename D>
+    void add(uint32_t id, S serialize, D deserialize)
+    {
+        add(type_id<T>(), id,
+            [serialize](const zero_copy_value& v, void* out, size_t cap)->size_t{
+                return serialize(v.cref<T>(), out, cap);
+            },
+            deserialize_func(std::move(deserialize)));
+    }
+    bool registered(type_id_t type) const
+    {
+        return type==type_id<std::nullptr_t>() || ids.count(type)!=0;
+    }
+    // bytes serialize(v, ...) needs, padding included
+    size_t serialized_size(const zero_copy_value& v) const
+    {
+        if(v.empty()) return header_size;
+        return header_size + padded(find(v.id()).serialize(v, nullptr, 0));
+    }
+    // writes v as one record to out; returns the bytes written.
+    // throws std::runtime_error if its type is not registered, std::length_error if cap is too small (see serialized_size)
+    size_t serialize(const zero_copy_value& v, void* out, size_t cap) const
+    {
+        if(cap<header_size) throw std::length_error("buffer too small for a record header");
+        record_header h{0, 0, 0};
+        unsigned char* payload=static_cast<unsigned char*>(out)+header_size;
+        if(!v.empty()){
+            const entry& e=find(v.id());
+            h.type=e.id;
+            h.size=e.serialize(v, payload, cap-header_size);
+        }
+        size_t total=header_size+padded(h.size);
+        if(total>cap) throw std::length_error("buffer too small for the record");
+        std::memcpy(out, &h, header_size);
+        std::memset(payload+h.size, 0, total-header_size-h.size);
+        return total;
+    }
+    // reads one record from data; *consumed, if given, receives its size so that the next record can be read.
+    // with an owner that keeps data alive, large payloads are referenced rather than copied
+    zero_copy_value deserialize(const void* data, size_t len, std::shared_ptr<const void> owner=nullptr, size_t* consumed=nullptr) const
+    {
+        if(len<header_size) throw std::runtime_error("truncated record header");
+        record_header h;
+        std::memcpy(&h, data, header_size);
+        if(h.size>len-header_size) throw std::runtime_error("truncated record");
+        if(consumed!=nullptr) *consumed=std::min<size_t>(len, header_size+padded(h.size));
+        if(h.type==0) return zero_copy_value();
+        auto it=by_id.find(h.type);
+        if(it==by_id.end()) throw std::runtime_error("unknown type id in record");
+        return it->second.deserialize(static_cast<const unsigned char*>(data)+header_size, h.size, owner);
+    }
+private:
+    struct entry{
+        uint32_t id;
+        serialize_func serialize;
+        deserialize_func deserialize;
+    };
+    void add(type_id_t type, uint32_t id, serialize_func s, deserialize_func d)
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if(id==0) throw std::logic_error("type id 0 is reserved for the empty value");
+        if(by_id.count(id)!=0 || ids.count(type)!=0) throw std::logic_error("type or type id registered twice");
+        by_id.emplace(id, entry{id, std::move(s), std::move(d)});
+        ids.emplace(type, id);
+    }
+    const entry& find(type_id_t type) const
+    {
+        auto it=ids.find(type);
+        if(it==ids.end()) throw std::runtime_error("type is not registered for serialization");
+        return by_id.find(it->second)->second;
+    }
+    static size_t padded(size_t n) noexcept
+    {
+        return (n+record_align-1)/record_align*record_align;
+    }
+
+    std::mutex mtx;
+    std::unordered_map<uint32_t, entry> by_id;
+    std::unordered_map<type_id_t, uint32_t> ids;
+};
+
+}
@@ -0,0 +1,89 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+/*
+span: a pointer and a length, the payload of zero_copy_value::slice
+
+    1. it does not own the elements; a slice value keeps whatever owns them alive
+    2. trivially copyable and two words wide, so a zero_copy_value stores it inline
+    3. span<const char> converts to std::string_view in C++17 builds; str() copies it into a std::string
+*/
+
+namespace eventual{
+
+template<typename T>
+class span{
+public:
+    using element_type = T;
+    using value_type = typename std::remove_cv<T>::type;
+    using iterator = T*;
+
+    span() noexcept : ptr(nullptr), n(0){}
+    span(T* data, size_t size) noexcept : ptr(data), n(size){}
+    T* data() const noexcept{ return ptr; }
+    size_t size() const noexcept{ return n; }
+    bool empty() const noexcept{ return n==0; }
+    T* begin() const noexcept{ return ptr; }
+    T* end() const noexcept{ return ptr+n; }
+    T& operator[](size_t i) const noexcept{ return ptr[i]; }
+    // count elements from offset on, clipped to the end
+    span subspan(size_t offset, size_t count=std::string::npos) const
+    {
+        if(offset>n) throw std::out_of_range("span::subspan offset out of range");
+        return span(ptr+offset, count<n-offset ? count : n-offset);
+    }
+    template<typename C=value_type, typename=typename std::enable_if<std::is_same<C, char>::value>::type>
+    std::string str() const
+    {
+        return std::string(ptr, n);
+    }
+#if __cplusplus >= 201703L
+    template<typename C=value_type, typename=typename std::enable_if<std::is_same<C, char>::value>::type>
+    operator std::string_view() const noexcept
+    {
+        return std::string_view(ptr, n);
+    }
+#endif
+private:
+    T* ptr;
+    size_t n;
+};
+
+template<typename T>
+struct is_span : std::false_type{};
+template<typename T>
+struct is_span<span<T>> : std::true_type{};
+
+}
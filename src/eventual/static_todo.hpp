@@ -0,0 +1,217 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+// make_todo is todo with its steps known at compile time:
+//      make_todo(job0)(job1)(job2)(job3)(job4,job3_err)[job4_err]();
+// every step keeps its own callable type, so nothing is type-erased into std::function and nothing is allocated;
+// running the chain is one switch over the state per step, with the callables inlined into it
+
+#include "todo.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace eventual
+{
+
+// what the steps of a make_todo chain and their providers see; the same protocol as todo:
+// a provider sets the state (resolve/reject/finish), then calls wake(), and does not touch the context afterwards
+class todo_context
+{
+public:
+    using state_t = todo::state_t;
+    todo_context() noexcept : state(todo::pending), waking(0), woken(false){}
+    // a provider may still be inside wake() when the runner sees it woken; wait until it has left
+    ~todo_context(){
+        while(waking.load(std::memory_order_acquire)!=0) std::this_thread::yield();
+    }
+    todo_context(const todo_context&)=delete;
+    todo_context& operator=(const todo_context&)=delete;
+
+    void resolve() noexcept{
+        state=todo::resolved;
+    }
+    void finish() noexcept{
+        state=todo::finished;
+    }
+    void reject() noexcept{
+        state=todo::rejected;
+    }
+    int get_state() noexcept{
+        return state.load();
+    }
+    void set_state(state_t i) noexcept{
+        state=i;
+    }
+    void complete(state_t state){
+        set_state(state);
+        wake();
+    }
+    // the context lives on the stack of run(), which does not return while a wake() is in progress
+    void wake(){
+        waking.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            woken=true;
+        }
+        cv.notify_one(); // outside the lock, so the runner does not wake up only to block on it
+        waking.fetch_sub(1, std::memory_order_release);
+    }
+private:
+    template<typename... Steps> friend class static_todo;
+    // call job, which hands the step to a provider, then wait for the provider to wake us
+    template<typename F>
+    void await(F& job){
+        woken=false; // no provider owns the context yet
+        set_state(todo::pending);
+        job(this);
+        std::unique_lock<std::mutex> lck(mtx);
+        while(!woken) cv.wait(lck);
+    }
+    std::atomic<int> state;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::atomic<int> waking;
+    bool woken;
+};
+
+// marks a step without on_resolve or without on_reject
+struct no_job{};
+
+template<typename OnResolve, typename OnReject>
+struct static_step
+{
+    OnResolve on_resolve;
+    OnReject on_reject;
+};
+
+template<typename... Steps>
+class static_todo
+{
+    template<typename F>
+    using job_t = typename std::conditional<std::is_same<typename std::decay<F>::type, std::nullptr_t>::value,
+        no_job, typename std::decay<F>::type>::type;
+    template<typename R, typename J>
+    using then_t = static_todo<Steps..., static_step<job_t<R>, job_t<J>>>;
+public:
+    explicit static_todo(std::tuple<Steps...> steps) : steps(std::move(steps)){}
+
+    // a builder that is a temporary, as in make_todo(a)(b)(c), hands its steps on; a named one is copied
+    template<typename R, typename J=no_job>
+    then_t<R, J> operator()(R&& on_resolve, J&& on_reject=J()) const&{
+        return then(std::forward<R>(on_resolve), std::forward<J>(on_reject));
+    }
+    template<typename R, typename J=no_job>
+    then_t<R, J> operator()(R&& on_resolve, J&& on_reject=J()) &&{
+        return std::move(*this).then(std::forward<R>(on_resolve), std::forward<J>(on_reject));
+    }
+    template<typename J>
+    then_t<no_job, J> operator[](J&& on_reject) const&{
+        return then(no_job(), std::forward<J>(on_reject));
+    }
+    template<typename J>
+    then_t<no_job, J> operator[](J&& on_reject) &&{
+        return std::move(*this).then(no_job(), std::forward<J>(on_reject));
+    }
+    template<typename R, typename J=no_job>
+    then_t<R, J> then(R&& on_resolve, J&& on_reject=J()) const&{
+        return append(steps, std::forward<R>(on_resolve), std::forward<J>(on_reject));
+    }
+    template<typename R, typename J=no_job>
+    then_t<R, J> then(R&& on_resolve, J&& on_reject=J()) &&{
+        return append(std::move(steps), std::forward<R>(on_resolve), std::forward<J>(on_reject));
+    }
+    // run the chain on this thread; returns once it has finished
+    void operator()(){
+        run();
+    }
+    void run(){
+        todo_context ctx;
+        ctx.set_state(todo::resolved); // the first step (init) always runs
+        run_from<0>(ctx, std::integral_constant<bool, 0<sizeof...(Steps)>());
+    }
+private:
+    template<size_t I>
+    void run_from(todo_context& ctx, std::true_type){
+        auto& s=std::get<I>(steps);
+        switch(detail::todo_transition(ctx.get_state(), has_job(s.on_resolve), has_job(s.on_reject))){
+        case detail::todo_next::call_on_resolve:
+            call(s.on_resolve, ctx);
+            break;
+        case detail::todo_next::call_on_reject:
+            call(s.on_reject, ctx);
+            return; // s quit
+        case detail::todo_next::finish:
+            return;
+        }
+        run_from<I+1>(ctx, std::integral_constant<bool, I+1<sizeof...(Steps)>());
+    }
+    template<size_t I>
+    void run_from(todo_context&, std::false_type){}
+
+    // known at compile time, so todo_transition folds into the switch
+    template<typename F>
+    static constexpr bool has_job(const F&){
+        return true;
+    }
+    static constexpr bool has_job(const no_job&){
+        return false;
+    }
+    template<typename F>
+    static void call(F& job, todo_context& ctx){
+        ctx.await(job);
+    }
+    static void call(no_job&, todo_context&){} // never called: has_job is false
+    template<typename R, typename J>
+    static then_t<R, J> append(std::tuple<Steps...> base, R&& on_resolve, J&& on_reject){
+        return then_t<R, J>(std::tuple_cat(std::move(base),
+            std::make_tuple(static_step<job_t<R>, job_t<J>>{job(std::forward<R>(on_resolve)), job(std::forward<J>(on_reject))})));
+    }
+    template<typename F>
+    static F&& job(F&& f){
+        return std::forward<F>(f);
+    }
+    static no_job job(std::nullptr_t){
+        return no_job();
+    }
+
+    std::tuple<Steps...> steps;
+};
+
+// todo{init} with compile-time steps: make_todo(init)(job1)(job2, job1_err)[job2_err]()
+template<typename F>
+static_todo<static_step<typename std::decay<F>::type, no_job>> make_todo(F&& init)
+{
+    using step_t = static_step<typename std::decay<F>::type, no_job>;
+    return static_todo<step_t>(std::make_tuple(step_t{std::forward<F>(init), no_job()}));
+}
+
+}
@@ -0,0 +1,194 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+//
+// fixed-sized RAII work-stealing threadpool
+//
+//  1. every worker owns a deque; tasks submitted from a worker go to its own deque (LIFO for the owner)
+//  2. tasks submitted from outside the pool go to a global injection queue
+//  3. an idle worker looks at its own deque, then the injection queue, then steals (FIFO) from the others
+//
+// The per-deque locks are almost never contended: only the owner and an occasional thief touch them.
+//
+
+#include "task.hpp"
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+namespace eventual {
+
+class stealing_threadpool {
+public:
+    using func=task;
+    explicit stealing_threadpool(size_t nr_thread) : meta_(std::make_shared<meta>(nr_thread)) {
+        for (size_t i = 0; i < nr_thread; i++) {
+            std::shared_ptr<meta> m = meta_; // workers must not touch *this; it may be gone before them
+            std::thread([m, i]{
+                current() = worker_ctx{m.get(), i};
+                m->work(i);
+                current() = worker_ctx{};
+            }).detach();
+        }
+    }
+    stealing_threadpool() = delete;
+    stealing_threadpool(stealing_threadpool &&) = default;
+    ~stealing_threadpool() {
+        if ((bool) meta_) {
+            {
+                std::lock_guard<std::mutex> lk(meta_->mtx_);
+                meta_->is_shutdown_ = true;
+            }
+            meta_->cond_.notify_all();
+        }
+    }
+    void run(func task) {
+        const worker_ctx& ctx = current();
+        if (ctx.owner == meta_.get()) {
+            worker_queue& q = *meta_->queues_[ctx.index];
+            std::lock_guard<std::mutex> lk(q.mtx_);
+            q.tasks_.emplace_back(std::move(task));
+            q.size_.store(q.tasks_.size(), std::memory_order_relaxed);
+        } else {
+            std::lock_guard<std::mutex> lk(meta_->mtx_);
+            meta_->injected_.emplace(std::move(task));
+            meta_->nr_injected_.store(meta_->injected_.size(), std::memory_order_relaxed);
+        }
+        meta_->notify();
+    }
+    size_t size() const noexcept {
+        return meta_->queues_.size();
+    }
+private:
+    struct worker_ctx {
+        void*  owner = nullptr;
+        size_t index = 0;
+    };
+    // which pool (if any) the calling thread works for
+    static worker_ctx& current() {
+        static thread_local worker_ctx ctx;
+        return ctx;
+    }
+    struct worker_queue {
+        std::mutex mtx_;
+        std::deque<func> tasks_;
+        // lets others skip an empty deque without taking its lock
+        std::atomic<size_t> size_{0};
+    };
+    struct meta {
+        explicit meta(size_t nr_thread) {
+            for (size_t i = 0; i < nr_thread; i++) {
+                queues_.emplace_back(new worker_queue);
+            }
+        }
+        std::vector<std::unique_ptr<worker_queue>> queues_;
+        // guards injected_, is_shutdown_ and sleeping
+        std::mutex mtx_;
+        std::condition_variable cond_;
+        bool is_shutdown_ = false;
+        std::queue<func> injected_;
+        std::atomic<size_t> nr_injected_{0};
+        // bumped on every submission; a worker only sleeps if nothing was submitted since it started searching
+        std::atomic<size_t> nr_submitted_{0};
+        std::atomic<size_t> nr_idle_{0};
+
+        // a sleeping worker bumps nr_idle_ before re-checking nr_submitted_, a submitter bumps nr_submitted_ before checking nr_idle_
+        // so at least one of them sees the other
+        void notify() {
+            nr_submitted_.fetch_add(1);
+            if (nr_idle_.load() > 0) {
+                std::lock_guard<std::mutex> lk(mtx_);
+                cond_.notify_one();
+            }
+        }
+        static bool pop_back(worker_queue& q, func& out) {
+            if (q.size_.load(std::memory_order_relaxed) == 0) return false;
+            std::lock_guard<std::mutex> lk(q.mtx_);
+            if (q.tasks_.empty()) return false;
+            out = std::move(q.tasks_.back());
+            q.tasks_.pop_back();
+            q.size_.store(q.tasks_.size(), std::memory_order_relaxed);
+            return true;
+        }
+        static bool pop_front(worker_queue& q, func& out) {
+            if (q.size_.load(std::memory_order_relaxed) == 0) return false;
+            std::lock_guard<std::mutex> lk(q.mtx_);
+            if (q.tasks_.empty()) return false;
+            out = std::move(q.tasks_.front());
+            q.tasks_.pop_front();
+            q.size_.store(q.tasks_.size(), std::memory_order_relaxed);
+            return true;
+        }
+        bool pop_injected(func& out) {
+            if (nr_injected_.load(std::memory_order_relaxed) == 0) return false;
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (injected_.empty()) return false;
+            out = std::move(injected_.front());
+            injected_.pop();
+            nr_injected_.store(injected_.size(), std::memory_order_relaxed);
+            return true;
+        }
+        bool steal(size_t i, func& out) {
+            size_t n = queues_.size();
+            for (size_t k = 1; k < n; k++) {
+                if (pop_front(*queues_[(i + k) % n], out)) return true;
+            }
+            return false;
+        }
+        bool pop(size_t i, size_t tick, func& out) {
+            // look at the injection queue first once in a while, so that external submissions
+            // are not starved by a worker that keeps feeding itself
+            if (tick % 61 == 0 && pop_injected(out)) return true;
+            return pop_back(*queues_[i], out) || pop_injected(out) || steal(i, out);
+        }
+        void work(size_t i) {
+            for (size_t tick = 1;; tick++) {
+                size_t seen = nr_submitted_.load();
+                func current;
+                if (pop(i, tick, current)) {
+                    current();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lk(mtx_);
+                nr_idle_.fetch_add(1);
+                while (nr_submitted_.load() == seen && !is_shutdown_) {
+                    cond_.wait(lk);
+                }
+                nr_idle_.fetch_sub(1);
+                // queues were empty when we looked and nothing came in since
+                if (is_shutdown_ && nr_submitted_.load() == seen) break;
+            }
+        }
+    };
+    std::shared_ptr<meta> meta_;
+};
+}
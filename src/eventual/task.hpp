@@ -0,0 +1,159 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace eventual{
+
+/*
+task: a move-only void() callable
+
+    1. callables up to inline_size bytes (which covers the continuations built by promise_t) are stored inline,
+       so creating, queueing and running such a task never touches the heap
+    2. larger callables, or callables that may throw when moved, fall back to a single heap allocation
+    3. unlike std::function, the callable does not need to be copyable
+*/
+class task{
+public:
+    static constexpr size_t inline_size = 16 * sizeof(void*);
+
+    task() noexcept : ops(nullptr){}
+    task(std::nullptr_t) noexcept : ops(nullptr){}
+
+    template<typename F, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, task>::value>::type>
+    task(F&& f) : ops(nullptr)
+    {
+        using func_t = typename std::decay<F>::type;
+        construct<func_t>(std::forward<F>(f), std::integral_constant<bool, fits_inline<func_t>()>());
+    }
+    task(task&& d) noexcept : ops(d.ops)
+    {
+        if(ops!=nullptr){
+            ops->move(buf, d.buf);
+            d.ops=nullptr;
+        }
+    }
+    task& operator= (task&& d) noexcept{
+        if(this!=&d){
+            reset();
+            if(d.ops!=nullptr){
+                d.ops->move(buf, d.buf);
+                ops=d.ops;
+                d.ops=nullptr;
+            }
+        }
+        return *this;
+    }
+    task& operator= (std::nullptr_t) noexcept{
+        reset();
+        return *this;
+    }
+    task(const task&) = delete;
+    task& operator= (const task&) = delete;
+    ~task(){
+        reset();
+    }
+    explicit operator bool() const noexcept{
+        return ops!=nullptr;
+    }
+    void operator()(){
+        if(ops==nullptr) throw std::bad_function_call();
+        ops->invoke(buf);
+    }
+    // whether the callable lives inside the task object itself
+    bool is_inline() const noexcept{
+        return ops!=nullptr && ops->is_inline;
+    }
+private:
+    struct ops_t{
+        void (*invoke)(void*);
+        void (*move)(void* dst, void* src) noexcept;
+        void (*destroy)(void*) noexcept;
+        bool is_inline;
+    };
+
+    template<typename F>
+    static constexpr bool fits_inline(){
+        return sizeof(F)<=inline_size && alignof(std::max_align_t)%alignof(F)==0
+            && std::is_nothrow_move_constructible<F>::value;
+    }
+
+    template<typename F>
+    struct inline_ops{
+        static void invoke(void* p){ (*static_cast<F*>(p))(); }
+        static void move(void* dst, void* src) noexcept{
+            new(dst) F(std::move(*static_cast<F*>(src)));
+            static_cast<F*>(src)->~F();
+        }
+        static void destroy(void* p) noexcept{ static_cast<F*>(p)->~F(); }
+        static const ops_t* table(){
+            static const ops_t t{&invoke, &move, &destroy, true};
+            return &t;
+        }
+    };
+
+    template<typename F>
+    struct heap_ops{
+        static F*& ptr(void* p){ return *static_cast<F**>(p); }
+        static void invoke(void* p){ (*ptr(p))(); }
+        static void move(void* dst, void* src) noexcept{
+            new(dst) F*(ptr(src));
+        }
+        static void destroy(void* p) noexcept{ delete ptr(p); }
+        static const ops_t* table(){
+            static const ops_t t{&invoke, &move, &destroy, false};
+            return &t;
+        }
+    };
+
+    template<typename F, typename Arg>
+    void construct(Arg&& f, std::true_type){
+        new(buf) F(std::forward<Arg>(f));
+        ops=inline_ops<F>::table();
+    }
+    template<typename F, typename Arg>
+    void construct(Arg&& f, std::false_type){
+        new(buf) F*(new F(std::forward<Arg>(f)));
+        ops=heap_ops<F>::table();
+    }
+    void reset() noexcept{
+        if(ops!=nullptr){
+            ops->destroy(buf);
+            ops=nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char buf[inline_size];
+    const ops_t* ops;
+};
+
+}
@@ -8,32 +8,34 @@
 #pragma once
 
 
+#include "task.hpp"
 #include <mutex>
 #include <condition_variable>
-#include <functional>
 #include <queue>
 #include <thread>
+#include <memory>
 
 namespace eventual {
 
 class threadpool {
 public:
-    using func=std::function<void()>;
+    using func=task;
     explicit threadpool(size_t nr_thread) : meta_(std::make_shared<meta>()) {
         for (size_t i = 0; i < nr_thread; i++) {
-            std::thread([this]{
-                std::unique_lock<std::mutex> lk(meta_->mtx_);
+            std::shared_ptr<meta> m = meta_; // workers must not touch *this; it may be gone before them
+            std::thread([m]{
+                std::unique_lock<std::mutex> lk(m->mtx_);
                 for (;;) {
-                    if (!meta_->tasks_.empty()) {
-                        auto current = meta_->tasks_.front();
-                        meta_->tasks_.pop();
+                    if (!m->tasks_.empty()) {
+                        auto current = std::move(m->tasks_.front());
+                        m->tasks_.pop();
                         lk.unlock();
                         current();
                         lk.lock();
-                    } else if (meta_->is_shutdown_) {
+                    } else if (m->is_shutdown_) {
                         break;
                     } else {
-                        meta_->cond_.wait(lk);
+                        m->cond_.wait(lk);
                     }
                 }
             }).detach();
@@ -53,7 +55,7 @@ public:
     void run(func task) {
         {
             std::lock_guard<std::mutex> lk(meta_->mtx_);
-            meta_->tasks_.emplace(task);
+            meta_->tasks_.emplace(std::move(task));
         }
         meta_->cond_.notify_one();
     }
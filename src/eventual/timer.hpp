@@ -0,0 +1,296 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "task.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+timer_service: a hierarchical timing wheel serviced by a single thread
+
+    1. 4 levels of 256 slots with a 1ms tick cover 2^32ms (about 49 days); a later deadline is parked in the last level and re-cascaded
+    2. a slot is an intrusive doubly linked list, so schedule and cancel are O(1) under one short lock
+    3. whenever a level wraps, the next slot of the level above is cascaded down; a timer moves at most 3 times before it fires
+    4. expired tasks are handed to the executor outside the lock; the timer thread never runs them itself.
+       the destructor waits for a handover in progress, so the executor is never called once the service is gone
+    5. nodes are recycled through a free list and addressed by index; a timer_id carries the generation of its node,
+       so cancelling a timer that already fired (and whose node was reused) is a harmless no-op
+*/
+
+namespace eventual{
+
+struct timer_id{
+    uint32_t index = 0;
+    uint32_t generation = 0;  // node generations start at 1: a default timer_id refers to nothing
+};
+
+class timer_service{
+public:
+    using clock = std::chrono::steady_clock;
+    using executor_func = std::function<void(task)>;
+
+    static constexpr size_t nr_levels = 4;
+    static constexpr size_t slot_bits = 8;
+    static constexpr size_t nr_slots = 1 << slot_bits;
+
+    explicit timer_service(executor_func executor) : meta_(std::make_shared<meta>())
+    {
+        meta_->executor=std::move(executor);
+        meta_->origin=clock::now();
+        std::shared_ptr<meta> m = meta_; // the timer thread must not touch *this; it may be gone before it
+        std::thread worker([m]{
+            std::vector<task> ready;
+            std::unique_lock<std::mutex> lk(m->mtx_);
+            while(!m->is_shutdown_){
+                m->advance(m->tick_of(clock::now()), ready);
+                if(!ready.empty()){
+                    m->executing_=true;
+                    lk.unlock();
+                    for(auto& t : ready) m->executor(std::move(t));
+                    ready.clear();
+                    lk.lock();
+                    m->executing_=false;
+                    if(m->is_shutdown_) m->cond_.notify_all(); // the destructor is waiting for us
+                    continue;
+                }
+                m->wake_tick_=m->next_tick();
+                if(m->wake_tick_==UINT64_MAX){
+                    m->cond_.wait(lk);
+                }else{
+                    m->cond_.wait_until(lk, m->origin+std::chrono::milliseconds(m->wake_tick_));
+                }
+            }
+        });
+        meta_->thread_=worker.get_id();
+        worker.detach();
+    }
+    timer_service() = delete;
+    timer_service(const timer_service&) = delete;
+    // returns once the timer thread is outside the executor; it may outlive *this, but never calls the executor again
+    ~timer_service()
+    {
+        std::unique_lock<std::mutex> lk(meta_->mtx_);
+        meta_->is_shutdown_ = true;
+        meta_->cond_.notify_all();
+        // unless a task the executor runs right on the timer thread is destroying us: it is the handover
+        while(meta_->executing_ && std::this_thread::get_id()!=meta_->thread_) meta_->cond_.wait(lk);
+    }
+
+    // run f on the executor once when has passed (never earlier, usually within a tick after)
+    timer_id schedule(clock::time_point when, task f)
+    {
+        uint64_t expires=meta_->deadline_of(when);
+        bool wake;
+        timer_id id;
+        {
+            std::lock_guard<std::mutex> lk(meta_->mtx_);
+            node_t* n=meta_->acquire();
+            n->fn=std::move(f);
+            n->expires=expires;
+            meta_->insert(n);
+            meta_->count_++;
+            id.index=n->index;
+            id.generation=n->generation;
+            wake=expires<meta_->wake_tick_;
+            if(wake) meta_->wake_tick_=expires;
+        }
+        if(wake) meta_->cond_.notify_one();
+        return id;
+    }
+    timer_id schedule_after(clock::duration d, task f)
+    {
+        return schedule(clock::now()+d, std::move(f));
+    }
+    // true if the timer was removed before it fired; its task is destroyed without running
+    bool cancel(timer_id id)
+    {
+        task dropped;
+        {
+            std::lock_guard<std::mutex> lk(meta_->mtx_);
+            node_t* n=meta_->find(id);
+            if(n==nullptr) return false;
+            meta_->unlink(n);
+            meta_->count_--;
+            dropped=std::move(n->fn);
+            meta_->release(n);
+        }
+        return true;
+    }
+    // timers scheduled and neither fired nor cancelled
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lk(meta_->mtx_);
+        return meta_->count_;
+    }
+
+private:
+    struct node_t{
+        task        fn;
+        uint64_t    expires = 0;      // in ticks since origin
+        node_t*     prev = nullptr;
+        node_t*     next = nullptr;   // also links the free list
+        node_t**    slot = nullptr;   // the list head it is in; nullptr if not armed
+        uint32_t    index = 0;
+        uint32_t    generation = 1;
+    };
+    static constexpr size_t chunk_bits = 12;
+
+    struct meta {
+        std::mutex mtx_;
+        std::condition_variable cond_;
+        bool is_shutdown_ = false;
+        bool executing_ = false;            // the timer thread is handing expired tasks to the executor
+        std::thread::id thread_;            // the timer thread
+        executor_func executor;
+        clock::time_point origin;
+        node_t* wheel_[nr_levels][nr_slots] = {};
+        uint64_t current_ = 0;              // the next tick to process; every earlier one is done
+        uint64_t wake_tick_ = UINT64_MAX;   // when the timer thread will look again
+        size_t count_ = 0;
+        std::vector<std::unique_ptr<node_t[]>> chunks_;
+        node_t* free_ = nullptr;
+
+        uint64_t tick_of(clock::time_point t) const
+        {
+            auto since=t-origin;
+            return since.count()<=0 ? 0 : (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(since).count();
+        }
+        // rounded up: a timer never fires early
+        uint64_t deadline_of(clock::time_point t) const
+        {
+            auto since=t-origin;
+            if(since.count()<=0) return 0;
+            auto ms=std::chrono::duration_cast<std::chrono::milliseconds>(since);
+            return (uint64_t)ms.count()+(ms<since ? 1 : 0);
+        }
+        node_t* acquire()
+        {
+            if(free_==nullptr){
+                size_t base=chunks_.size()<<chunk_bits;
+                chunks_.emplace_back(new node_t[1<<chunk_bits]);
+                node_t* chunk=chunks_.back().get();
+                for(size_t i=(1<<chunk_bits); i>0; i--){
+                    chunk[i-1].index=(uint32_t)(base+i-1);
+                    chunk[i-1].next=free_;
+                    free_=&chunk[i-1];
+                }
+            }
+            node_t* n=free_;
+            free_=n->next;
+            return n;
+        }
+        void release(node_t* n)
+        {
+            n->generation++;
+            n->next=free_;
+            free_=n;
+        }
+        node_t* find(timer_id id)
+        {
+            size_t chunk=id.index>>chunk_bits;
+            if(chunk>=chunks_.size()) return nullptr;
+            node_t* n=&chunks_[chunk][id.index&((1<<chunk_bits)-1)];
+            return n->generation==id.generation && n->slot!=nullptr ? n : nullptr;
+        }
+        void insert(node_t* n)
+        {
+            if(n->expires<current_) n->expires=current_;
+            uint64_t delta=n->expires-current_;
+            size_t level=0;
+            while(level+1<nr_levels && delta>=((uint64_t)1<<(slot_bits*(level+1)))) level++;
+            uint64_t at=n->expires;
+            if(delta>=((uint64_t)1<<(slot_bits*nr_levels))) at=current_+((uint64_t)1<<(slot_bits*nr_levels))-1; // parked
+            node_t** slot=&wheel_[level][(at>>(slot_bits*level))&(nr_slots-1)];
+            n->slot=slot;
+            n->prev=nullptr;
+            n->next=*slot;
+            if(*slot!=nullptr) (*slot)->prev=n;
+            *slot=n;
+        }
+        void unlink(node_t* n)
+        {
+            if(n->prev!=nullptr) n->prev->next=n->next;
+            else *n->slot=n->next;
+            if(n->next!=nullptr) n->next->prev=n->prev;
+            n->slot=nullptr;
+        }
+        // move every timer of a slot one level down
+        void cascade(size_t level)
+        {
+            node_t*& slot=wheel_[level][(current_>>(slot_bits*level))&(nr_slots-1)];
+            node_t* n=slot;
+            slot=nullptr;
+            while(n!=nullptr){
+                node_t* next=n->next;
+                insert(n);
+                n=next;
+            }
+        }
+        // process every tick up to and including now
+        void advance(uint64_t now, std::vector<task>& ready)
+        {
+            if(count_==0){
+                if(current_<=now) current_=now+1; // nothing to cascade: jump
+                return;
+            }
+            while(current_<=now){
+                for(size_t level=1; level<nr_levels; level++){
+                    if(((current_>>(slot_bits*(level-1)))&(nr_slots-1))!=0) break;
+                    cascade(level);
+                }
+                node_t*& slot=wheel_[0][current_&(nr_slots-1)];
+                while(slot!=nullptr){
+                    node_t* n=slot;
+                    slot=n->next;
+                    n->slot=nullptr;
+                    ready.push_back(std::move(n->fn));
+                    release(n);
+                    count_--;
+                }
+                current_++;
+            }
+        }
+        // the next tick worth waking up for: the first non-empty level 0 slot, or the next cascade
+        uint64_t next_tick() const
+        {
+            if(count_==0) return UINT64_MAX;
+            for(uint64_t t=current_; ; t++){
+                if(wheel_[0][t&(nr_slots-1)]!=nullptr) return t;
+                if((t&(nr_slots-1))==0) return t; // current_ included: its cascade has not happened yet
+            }
+        }
+    };
+    std::shared_ptr<meta> meta_;
+};
+
+}
@@ -28,20 +28,40 @@
 // todo is not a part of promise implementation
 // it's just a funny way to organize code  
 
+// run() blocks the calling thread until each provider wakes it;
+// run_async(executor) blocks nothing: a provider's wake() schedules the next step on the executor,
+// so a fixed-size pool can drive any number of chains in flight;
+// parallel(jobs) is a step whose providers all work at once, joined by an atomic countdown;
+// a provider completes a step with complete(state), or with resolve()/reject()/finish() followed by wake()
+
+#include "parking.hpp"
+#include "task.hpp"
 #include <functional>
 #include <list>
 #include <memory>
-#include <mutex>              
-#include <condition_variable> 
 #include <atomic>
+#include <stdexcept>
+#include <vector>
 
 namespace eventual
 {
 
+namespace detail{
+// what a chain does with its next step once the step before has completed; the one state machine
+// behind todo::run, todo::run_async, todo_plan and make_todo (defined after todo)
+enum class todo_next{
+    call_on_resolve,    // the step before resolved
+    call_on_reject,     // the step before rejected; the chain ends with this job
+    finish              // finished, or no job to call: the chain ends here
+};
+inline todo_next todo_transition(int state, bool has_on_resolve, bool has_on_reject);
+}
+
 class todo
 {
 public:
     using func = std::function<void(todo*)>;
+    using executor_func = std::function<void(task)>;
     todo(func init=nullptr) : meta(std::make_shared<meta_t>(init)){}
     enum state_t : int{
         pending = 0,
@@ -49,6 +69,12 @@ public:
         rejected = 2,
         finished = 3
     };
+    // when a parallel step is complete
+    enum class join_policy{
+        fail_fast,  // resolved once every job has resolved; rejected as soon as one rejects
+        all,        // waits for every job; rejected if any of them rejected
+        any         // resolved as soon as one resolves; rejected once every job has rejected
+    };
     todo(const todo& d) noexcept : meta(d.meta){}
 
     todo& operator= (todo&& d) noexcept{
@@ -86,50 +112,69 @@ public:
         meta->steps.emplace_back(on_resolve, on_reject);
         return *this;
     }
+
+    // a step that calls every job at once; each job gets its own todo, which its provider resolves or rejects and wakes
+    // as usual (finish counts as resolved). the chain goes on, resolved or rejected, as soon as policy decides;
+    // providers that complete after that are ignored. as with then, on_reject handles a rejection of the step before,
+    // and a rejected group is handled by the on_reject of the step after
+    todo& parallel(std::vector<func> jobs, func on_reject=nullptr, join_policy policy=join_policy::fail_fast){
+        auto shared_jobs=std::make_shared<const std::vector<func>>(std::move(jobs));
+        return then([shared_jobs, policy](todo* self){
+            auto g=std::make_shared<group_t>(*self, shared_jobs->size(), policy);
+            if(shared_jobs->empty()){
+                g->decide(resolved);
+                return;
+            }
+            for(const func& job : *shared_jobs){
+                todo branch(from_meta(), std::make_shared<meta_t>(nullptr));
+                branch.meta->group=g;
+                job(&branch);
+            }
+        }, on_reject);
+    }
     
     void run(){
-        std::unique_lock<std::mutex> lck(meta->mtx);
-
         if(meta->init!=nullptr){
             set_state(pending);
-            meta->init(this);
-            while(get_state()==pending) meta->cv.wait(lck);
+            await(meta->init);
         }
         for(auto s: meta->steps){
-            std::function<void()> run_next[4]={
-                [&](){
-                    // normally code won't run into this function; you should never wake a todo in a pending state
-                    throw std::runtime_error("provider woke this todo object without setting its state properly!");
-                },
-                [&](){
-                    set_state(pending);
-                    if(s.on_resolve!=nullptr){
-                        s.on_resolve(this);
-                        while(get_state()==pending) meta->cv.wait(lck); // waiting till completion
-                    }
-                    else{ 
-                        set_state(finished);
-                    }
-                },
-                [&](){
-                    if(s.on_reject!=nullptr){
-                        set_state(pending);
-                        s.on_reject(this);
-                        while(get_state()==pending) meta->cv.wait(lck); 
-                    }
-                    set_state(finished); // s quit; no matter if on_reject exists
-                },
-                [&](){
-                    // nothing to do here, let's finish the run
-                }
-            };
-            run_next[get_state()]();
-            if(get_state()==finished){
-                break;
+            detail::todo_next next=detail::todo_transition(get_state(), s.on_resolve!=nullptr, s.on_reject!=nullptr);
+            if(next==detail::todo_next::finish) break;
+            set_state(pending);
+            if(next==detail::todo_next::call_on_resolve){
+                await(s.on_resolve); // waiting till completion
+                continue;
             }
+            await(s.on_reject);
+            break; // s quit; no matter if on_reject exists
         }
         set_state(finished);
     }
+    // run without waiting: init and every step are called on the executor, one at a time;
+    // on_done, if any, is called there once the chain has finished. providers complete a step exactly as with run():
+    // set the state (resolve/reject/finish), then wake(), once per step
+    void run_async(executor_func executor, func on_done=nullptr){
+        if(meta->init==nullptr && get_state()==pending){
+            throw std::runtime_error("a todo without init must be resolved before it runs");
+        }
+        meta->executor=executor;
+        meta->on_done=std::move(on_done);
+        meta->cursor=meta->steps.begin();
+        meta->quitting=false;
+        meta->async.store(true, std::memory_order_release);
+        std::shared_ptr<meta_t> m=meta;
+        // our own copy: the chain may finish, and run again, before this call returns
+        executor([m]{
+            if(m->init!=nullptr){
+                todo self(from_meta(), m);
+                self.set_state(pending);
+                m->init(&self);
+                return;
+            }
+            advance(m);
+        });
+    }
     void resolve() noexcept{
         meta->state=resolved;
     }
@@ -140,15 +185,38 @@ public:
         meta->state=rejected;
     }
     int get_state() noexcept{
-        return meta->state.load();
+        return meta->state.load() & state_mask;
     }
     void set_state(state_t i) noexcept{
         meta->state=i;
     }
+    // set the state and wake the todo object in one go; with run(), this is a single atomic exchange,
+    // plus a futex wake only if the runner is already parked
+    void complete(state_t state){
+        if(meta->group!=nullptr || meta->async.load(std::memory_order_acquire)){
+            set_state(state);
+            wake();
+            return;
+        }
+        if(meta->state.exchange(state) & parked) parking::unpark_all(meta->state);
+    }
     // this functon is called by provider;
     // provider should set state to rejected/resolved before waking the todo object
-    void wake() noexcept{
-        meta->cv.notify_all();
+    void wake(){
+        if(meta->group!=nullptr){ // a job of a parallel step
+            meta->group->arrive(get_state());
+            return;
+        }
+        if(meta->async.load(std::memory_order_acquire)){
+            std::shared_ptr<meta_t> m=meta;
+            // a copy, read before the next step is queued: once it is, the chain may finish
+            // and run again with another executor while this call is still inside the old one
+            executor_func executor=m->executor;
+            executor([m]{ advance(m); });
+            return;
+        }
+        // setting the state has cleared the parked flag, so the runner either has not parked yet or is woken here
+        parking::unpark_all(meta->state);
     }
 private:
     struct step_t{
@@ -156,17 +224,104 @@ private:
         func on_resolve;
         func on_reject;
     };
+    struct group_t;
     struct meta_t{
-        meta_t(func init) : state(pending), init(init){}
-        std::atomic<int> state;
-        std::mutex mtx;
-        std::condition_variable cv;
+        meta_t(func init) : state(pending), init(init), quitting(false), async(false){}
+        std::atomic<int> state;     // a state_t, plus parked while run() waits on it
         func init;
         std::list<step_t> steps;
+        // run_async only; a step is handed over through the executor, which orders these between steps
+        executor_func executor;
+        func on_done;
+        std::list<step_t>::iterator cursor;
+        bool quitting;  // an on_reject step is running; the chain ends with it
+        std::atomic<bool> async;    // run_async is driving the chain: wake() goes to the executor; cleared once it ends
+        std::shared_ptr<group_t> group; // set for the jobs of a parallel step only
     };
+    // the join of a parallel step: one countdown and one decision, both atomic, so jobs never take a lock
+    struct group_t{
+        group_t(const todo& parent, size_t n, join_policy policy) : parent(parent.meta), remaining(n), failed(false), decided(false), policy(policy){}
+        void arrive(int state){
+            bool ok=state!=rejected;
+            if(!ok) failed.store(true, std::memory_order_relaxed);
+            if(policy==join_policy::fail_fast && !ok) decide(rejected);
+            if(policy==join_policy::any && ok) decide(resolved);
+            if(remaining.fetch_sub(1, std::memory_order_acq_rel)==1){
+                bool any_failed=failed.load(std::memory_order_relaxed);
+                decide(policy==join_policy::any ? rejected : (any_failed ? rejected : resolved));
+            }
+        }
+        // only the first decision wakes the chain
+        void decide(state_t state){
+            if(decided.exchange(true, std::memory_order_acq_rel)) return;
+            todo chain(from_meta(), parent);
+            chain.complete(state);
+        }
+        std::shared_ptr<meta_t> parent;
+        std::atomic<size_t> remaining;
+        std::atomic<bool> failed;
+        std::atomic<bool> decided;
+        const join_policy policy;
+    };
+    static constexpr int state_mask = 3;
+    static constexpr int parked = 4;
+
+    // call f, which hands the step to a provider, then wait for the provider to set the state and wake us.
+    // the runner announces that it parks by setting the parked flag, so complete() knows whether to wake it
+    void await(const func& f){
+        f(this);
+        int s=meta->state.load();
+        while((s & state_mask)==pending){
+            if(!(s & parked)){
+                if(!meta->state.compare_exchange_weak(s, s | parked)) continue;
+                s|=parked;
+            }
+            parking::park(meta->state, s);
+            s=meta->state.load();
+        }
+    }
+    struct from_meta{};
+    todo(from_meta, std::shared_ptr<meta_t> m) noexcept : meta(std::move(m)){}
+
+    // run_async: the step that was running has completed; call the next one, as run() would, or finish
+    static void advance(const std::shared_ptr<meta_t>& m){
+        todo self(from_meta(), m);
+        if(!m->quitting && m->cursor!=m->steps.end()){
+            step_t& s=*m->cursor++;
+            detail::todo_next next;
+            try{
+                next=detail::todo_transition(self.get_state(), s.on_resolve!=nullptr, s.on_reject!=nullptr);
+            }catch(...){
+                m->async.store(false, std::memory_order_release);
+                throw;
+            }
+            if(next!=detail::todo_next::finish){
+                m->quitting=next==detail::todo_next::call_on_reject;
+                self.set_state(pending);
+                (m->quitting ? s.on_reject : s.on_resolve)(&self);
+                return;
+            }
+        }
+        self.set_state(finished);
+        m->async.store(false, std::memory_order_release); // a later run() parks and is woken as usual
+        if(m->on_done!=nullptr) m->on_done(&self);
+    }
     std::shared_ptr<meta_t> meta;
 };
 
-
+inline detail::todo_next detail::todo_transition(int state, bool has_on_resolve, bool has_on_reject)
+{
+    switch(state){
+    case todo::resolved:
+        return has_on_resolve ? todo_next::call_on_resolve : todo_next::finish;
+    case todo::rejected:
+        return has_on_reject ? todo_next::call_on_reject : todo_next::finish; // the step quits; no matter if on_reject exists
+    case todo::finished:
+        return todo_next::finish;
+    default:
+        // normally code won't run into this; you should never wake a todo in a pending state
+        throw std::runtime_error("provider woke this todo object without setting its state properly!");
+    }
+}
 
 }
\ No newline at end of file
@@ -0,0 +1,196 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+// todo_plan is a todo chain built once and run many times, e.g. once per request:
+//      todo_plan plan(executor, job0); plan(job1)(job2)(job3)(job4,job3_err)[job4_err];
+//      plan.run(on_done); // for every request
+// the steps are shared, read-only, by every run; a run holds only its state, its step cursor and a reference to the plan,
+// and comes from the thread-caching pool (pool.hpp). runs are asynchronous, as todo::run_async
+
+#include "pool.hpp"
+#include "todo.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace eventual
+{
+
+class todo_run;
+
+namespace detail{
+
+struct todo_step{
+    std::function<void(todo_run*)> on_resolve;
+    std::function<void(todo_run*)> on_reject;
+};
+// a plan: read-only once a run has started
+struct todo_plan_meta{
+    todo_plan_meta(todo::executor_func executor, std::function<void(todo_run*)> init) : executor(std::move(executor)), init(std::move(init)){}
+    todo::executor_func executor;
+    std::function<void(todo_run*)> init;
+    std::vector<todo_step> steps;
+};
+// one run: its state and step cursor; a step is handed over through the executor, which orders these between steps
+struct todo_run_meta{
+    todo_run_meta(std::shared_ptr<const todo_plan_meta> plan, std::function<void(todo_run*)> on_done)
+        : refs(1), state(todo::pending), cursor(0), quitting(false), plan(std::move(plan)), on_done(std::move(on_done)){}
+    std::atomic<uint32_t> refs;
+    std::atomic<int> state;
+    uint32_t cursor;    // the next step
+    bool quitting;      // an on_reject step is running; the run ends with it
+    std::shared_ptr<const todo_plan_meta> plan;
+    std::function<void(todo_run*)> on_done;
+};
+
+}
+
+// what the steps of a plan and their providers see: one run of the plan. 
+// like todo, it is a handle: a provider keeps a copy until it has set the state (resolve/reject/finish) and called wake()
+class todo_run
+{
+public:
+    todo_run(const todo_run& d) noexcept : run(d.run){
+        run->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    todo_run(todo_run&& d) noexcept : run(d.run){
+        d.run=nullptr;
+    }
+    todo_run& operator= (todo_run d) noexcept{
+        std::swap(run, d.run);
+        return *this;
+    }
+    ~todo_run(){
+        if(run!=nullptr && run->refs.fetch_sub(1, std::memory_order_acq_rel)==1){
+            run->~todo_run_meta();
+            pool::deallocate(run);
+        }
+    }
+    bool operator== (const todo_run& d) const noexcept{
+        return run==d.run;
+    }
+    bool operator!= (const todo_run& d) const noexcept{
+        return !(*this==d);
+    }
+    void resolve() noexcept{
+        run->state=todo::resolved;
+    }
+    void finish() noexcept{
+        run->state=todo::finished;
+    }
+    void reject() noexcept{
+        run->state=todo::rejected;
+    }
+    int get_state() noexcept{
+        return run->state.load();
+    }
+    void set_state(todo::state_t i) noexcept{
+        run->state=i;
+    }
+    // schedules the next step on the plan's executor
+    inline void wake();
+    void complete(todo::state_t state){
+        set_state(state);
+        wake();
+    }
+private:
+    friend class todo_plan;
+    explicit todo_run(detail::todo_run_meta* r) noexcept : run(r){}
+    detail::todo_run_meta* run;
+};
+
+class todo_plan
+{
+public:
+    using func = std::function<void(todo_run*)>;
+    using executor_func = todo::executor_func;
+
+    todo_plan(executor_func executor, func init=nullptr) : meta(std::make_shared<detail::todo_plan_meta>(std::move(executor), std::move(init))){}
+
+    todo_plan& operator[](func on_reject){
+        return then(nullptr, on_reject);
+    }
+    todo_plan& operator()(func on_resolve, func on_reject=nullptr){
+        return then(on_resolve, on_reject);
+    }
+    // runs already started keep the steps they started with: a plan that is shared with them is cloned first
+    todo_plan& then(func on_resolve, func on_reject=nullptr){
+        if(meta.use_count()>1) meta=std::make_shared<detail::todo_plan_meta>(*meta);
+        meta->steps.push_back(detail::todo_step{std::move(on_resolve), std::move(on_reject)});
+        return *this;
+    }
+    // start one run: init (or the first step) is called on the executor, and on_done, if any, once the run has finished
+    void run(func on_done=nullptr) const{
+        void* p=pool::allocate(sizeof(detail::todo_run_meta));
+        todo_run r(new (p) detail::todo_run_meta(meta, std::move(on_done)));
+        if(meta->init==nullptr) r.resolve(); // nothing to wait for
+        meta->executor([r=std::move(r)]() mutable {
+            if(r.run->plan->init!=nullptr){
+                r.set_state(todo::pending);
+                r.run->plan->init(&r);
+                return;
+            }
+            advance(r);
+        });
+    }
+    size_t size() const noexcept{
+        return meta->steps.size();
+    }
+private:
+    friend class todo_run;
+
+    // the step that was running has completed; call the next one, as todo::run would, or finish
+    static void advance(todo_run& r){
+        detail::todo_run_meta& run=*r.run;
+        const detail::todo_plan_meta& plan=*run.plan;
+        if(!run.quitting && run.cursor<plan.steps.size()){
+            const detail::todo_step& s=plan.steps[run.cursor++];
+            detail::todo_next next=detail::todo_transition(r.get_state(), s.on_resolve!=nullptr, s.on_reject!=nullptr);
+            if(next!=detail::todo_next::finish){
+                run.quitting=next==detail::todo_next::call_on_reject;
+                r.set_state(todo::pending);
+                (run.quitting ? s.on_reject : s.on_resolve)(&r);
+                return;
+            }
+        }
+        r.set_state(todo::finished);
+        if(run.on_done!=nullptr) run.on_done(&r);
+    }
+
+    std::shared_ptr<detail::todo_plan_meta> meta;
+};
+
+inline void todo_run::wake()
+{
+    run->plan->executor([self=todo_run(*this)]() mutable { todo_plan::advance(self); });
+}
+
+}
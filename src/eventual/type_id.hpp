@@ -0,0 +1,91 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <type_traits>
+
+/*
+type_id: type identity without RTTI
+
+    1. every type T gets one constant type_record; its address is T's id, so comparing two types is comparing two pointers
+    2. works under -fno-rtti (cmake -Dno_rtti=ON), where EVENTUAL_NO_RTTI is defined and typeid is not available
+    3. ids are unique within a binary; a shared library that hides its symbols may get its own copy of an id
+*/
+
+#if !defined(__cpp_rtti) && !defined(__GXX_RTTI)
+#define EVENTUAL_NO_RTTI
+#endif
+
+#ifndef EVENTUAL_NO_RTTI
+#include <typeinfo>
+#endif
+
+namespace eventual{
+
+// a printable name of T: typeid(T).name() where RTTI is available, the compiler's spelling of T otherwise
+template<typename T>
+std::string type_name(){
+#ifndef EVENTUAL_NO_RTTI
+    return std::string(typeid(T).name());
+#else
+    std::string f(__PRETTY_FUNCTION__); // "... type_name() [with T = int; ...]" or "... [T = int]"
+    size_t from=f.find("T = ");
+    if(from==std::string::npos) return f;
+    from+=4;
+    size_t to=f.find_first_of(";]", from);
+    return f.substr(from, to==std::string::npos ? std::string::npos : to-from);
+#endif
+}
+
+// what an id points to: one constant record per type
+struct type_record{
+    std::string (*name)();
+#ifndef EVENTUAL_NO_RTTI
+    const std::type_info* info;
+#endif
+};
+using type_id_t = const type_record*;
+
+template<typename T>
+struct type_tag{
+    static const type_record record;
+};
+template<typename T>
+const type_record type_tag<T>::record = {
+    &type_name<T>,
+#ifndef EVENTUAL_NO_RTTI
+    &typeid(T),
+#endif
+};
+
+// cv-qualifiers and references do not make another type
+template<typename T>
+constexpr type_id_t type_id() noexcept{
+    return &type_tag<typename std::decay<T>::type>::record;
+}
+
+}
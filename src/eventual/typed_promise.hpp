@@ -0,0 +1,353 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 jipeng wu
+ * <recvfromsockaddr at gmail dot com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "promise.h"
+#include "pool.hpp"
+#include <atomic>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+/*
+promise<T>: the statically typed sibling of promise_t
+
+    1. T is stored inline in the shared state; continuations read it by const reference, nothing is type-erased
+    2. then(f) deduces the successor's type from f: f(const T&) returning U (or promise<U>) gives promise<U>
+    3. callbacks run in background threads, and rejection, exceptions and adoption behave exactly like promise_t
+    4. to_promise_t() and from(promise_t) convert at the boundaries; only there is T wrapped in / unwrapped from value_t
+*/
+
+namespace eventual{
+
+template<typename T>
+class promise{
+    static_assert(!std::is_void<T>::value && !std::is_reference<T>::value, "promise<T> needs an object type");
+    template<typename> friend class promise;
+
+    template<typename X> struct unwrap{ using type = X; };
+    template<typename X> struct unwrap<promise<X>>{ using type = X; };
+    // the successor type of then(F); spelled with decltype since std::result_of is gone in C++20
+    template<typename F>
+    using result_t = typename unwrap<typename std::decay<decltype(std::declval<F&>()(std::declval<const T&>()))>::type>::type;
+
+public:
+    using value_type = T;
+    // fulfill operation: provided by library, asynchronous
+    using fulfill_func = std::function<void(T)>;
+    // reject operation: provided by library, asynchronous
+    using reject_func = std::function<void(reason_t)>;
+    // initial function: provided by user
+    using init_func = std::function<void(fulfill_func, reject_func)>;
+
+    explicit promise(init_func init) : meta(make_meta())
+    {
+        if(init==nullptr) throw std::runtime_error("promise init_func should not be nullptr!");
+        std::shared_ptr<meta_t> m=meta;
+        init(
+            [m](T v){
+                meta_t::fulfill(m, std::move(v));
+            },
+            [m](reason_t r){
+                meta_t::reject(m, std::move(r));
+            }
+        );
+    }
+    static promise create_fulfilled_promise(T v)
+    {
+        promise p(make_meta());
+        meta_t::fulfill(p.meta, std::move(v));
+        return p;
+    }
+    static promise create_rejected_promise(reason_t r)
+    {
+        promise p(make_meta());
+        meta_t::reject(p.meta, std::move(r));
+        return p;
+    }
+
+    // f: const T& -> U or promise<U>
+    template<typename F>
+    promise<result_t<F>> then(F on_fulfilled)
+    {
+        return then(std::move(on_fulfilled), nullptr);
+    }
+    // r: reason_t -> U or promise<U>, or nullptr to pass the rejection on
+    template<typename F, typename R>
+    promise<result_t<F>> then(F on_fulfilled, R on_rejected)
+    {
+        using U = result_t<F>;
+        auto next=promise<U>::make_meta();
+        meta_t::subscribe(meta, new then_node<F, R, U>(std::move(on_fulfilled), std::move(on_rejected), next));
+        return promise<U>(next);
+    }
+
+    // the type-erased view of this promise; the value is wrapped in value_t here
+    promise_t to_promise_t() const
+    {
+        std::shared_ptr<meta_t> m=meta;
+        return promise_t([m](promise_t::fulfill_func f, promise_t::reject_func r){
+            meta_t::subscribe(m, new bridge_node(std::move(f), std::move(r)));
+        });
+    }
+    // the typed view of p; p's value must hold a T, or the result is rejected
+    static promise from(promise_t p)
+    {
+        return promise([p](fulfill_func f, reject_func r) mutable{
+            p.then(
+                [f, r](value_t v){
+                    if(const T* x=v.get_if<T>()) f(*x);
+                    else r(reason_t("T is not the type holded by this zero_copy_value"));
+                    return value_t();
+                },
+                [r](reason_t why){
+                    r(why);
+                    return value_t();
+                }
+            );
+        });
+    }
+
+    promise(const promise& d) : meta(d.meta){}
+    promise& operator= (promise&&d) noexcept{
+        meta.swap(d.meta);
+        return *this;
+    }
+    promise& operator= (const promise& d) noexcept{
+        meta=d.meta;
+        return *this;
+    }
+    bool operator== (const promise& d) const noexcept{
+        return meta==d.meta;
+    }
+    bool operator!= (const promise& d) const noexcept{
+        return !(*this==d);
+    }
+
+private:
+    enum state_t : int{
+        pending = 0,
+        fulfilled = 1,
+        rejected = 2,
+        settling = 3
+    };
+
+    struct meta_t;
+
+    // a pending continuation; an intrusive node of meta_t's lock-free stack
+    struct node_t{
+        node_t* next = nullptr;
+        virtual ~node_t(){}
+        // src has settled
+        virtual void run(const std::shared_ptr<meta_t>& src) = 0;
+        static void* operator new(size_t n){
+            return pool::allocate(n);
+        }
+        static void operator delete(void* p) noexcept{
+            pool::deallocate(p);
+        }
+    };
+
+    // same protocol as promise_t::promise_meta_t: pending -> settling -> fulfilled/rejected, plus a Treiber stack of continuations
+    struct meta_t{
+        std::atomic<int>        state{pending};
+        std::atomic<node_t*>    thens{nullptr};
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        reason_t                reason;
+
+        ~meta_t(){
+            if(state.load(std::memory_order_acquire)==fulfilled) value().~T();
+            node_t* head=thens.load(std::memory_order_acquire);
+            while(head!=nullptr && head!=closed()){
+                node_t* next=head->next;
+                delete head;
+                head=next;
+            }
+        }
+        T& value() noexcept{
+            return *reinterpret_cast<T*>(&storage);
+        }
+        bool is_fulfilled() const noexcept{
+            return state.load(std::memory_order_acquire)==fulfilled;
+        }
+
+        static node_t* closed() noexcept{
+            static char tag;
+            return reinterpret_cast<node_t*>(&tag);
+        }
+        bool try_settle() noexcept{
+            int expected=pending;
+            return state.compare_exchange_strong(expected, settling, std::memory_order_acquire);
+        }
+        // chained: see promise_meta_t::drain
+        template<typename V>
+        static void fulfill(const std::shared_ptr<meta_t>& self, V&& v, bool chained=false){
+            if(!self->try_settle()) return;
+            try{
+                new(&self->storage) T(std::forward<V>(v));
+            }catch(...){
+                self->reason=reason_t("failed to store the value");
+                self->state.store(rejected, std::memory_order_release);
+                drain(self, chained);
+                return;
+            }
+            self->state.store(fulfilled, std::memory_order_release);
+            drain(self, chained);
+        }
+        static void reject(const std::shared_ptr<meta_t>& self, reason_t r, bool chained=false){
+            if(!self->try_settle()) return;
+            self->reason=std::move(r);
+            self->state.store(rejected, std::memory_order_release);
+            drain(self, chained);
+        }
+        static void subscribe(const std::shared_ptr<meta_t>& self, node_t* n){
+            node_t* head=self->thens.load(std::memory_order_acquire);
+            while(head!=closed()){
+                n->next=head;
+                if(self->thens.compare_exchange_weak(head, n, std::memory_order_release, std::memory_order_acquire))
+                    return;
+            }
+            dispatch(self, n);
+        }
+        // inline_: see promise_engine::dispatch
+        static void dispatch(const std::shared_ptr<meta_t>& self, node_t* n, bool inline_=false){
+            std::unique_ptr<node_t> node(n);
+            task t([node=std::move(node), self]{
+                promise_engine::instance().run_continuation([&]{
+                    node->run(self);
+                });
+            });
+            if(inline_) promise_engine::instance().dispatch(std::move(t));
+            else promise_engine::instance().run(std::move(t));
+        }
+        static void drain(const std::shared_ptr<meta_t>& self, bool chained){
+            node_t* head=self->thens.exchange(closed(), std::memory_order_acq_rel);
+            node_t* ordered=nullptr;
+            while(head!=nullptr){
+                node_t* next=head->next;
+                head->next=ordered;
+                ordered=head;
+                head=next;
+            }
+            while(ordered!=nullptr){
+                node_t* next=ordered->next;
+                dispatch(self, ordered, chained && next==nullptr);
+                ordered=next;
+            }
+        }
+    };
+
+    template<typename X> struct is_promise : std::false_type{};
+    template<typename X> struct is_promise<promise<X>> : std::true_type{};
+
+    // promise resolution procedure for a typed successor: x is a plain value or a promise to adopt
+    template<typename U, typename X>
+    static void resolve(const std::shared_ptr<typename promise<U>::meta_t>& p, X&& x){
+        resolve<U>(p, std::forward<X>(x), is_promise<typename std::decay<X>::type>());
+    }
+    template<typename U, typename X>
+    static void resolve(const std::shared_ptr<typename promise<U>::meta_t>& p, X&& x, std::false_type){
+        promise<U>::meta_t::fulfill(p, std::forward<X>(x), true);
+    }
+    template<typename U>
+    static void resolve(const std::shared_ptr<typename promise<U>::meta_t>& p, const promise<U>& x, std::true_type){
+        if(x.meta==p){
+            promise<U>::meta_t::reject(p, reason_t("It's illogical for a promise to adopt the state of itself!"), true);
+            return;
+        }
+        promise<U>::meta_t::subscribe(x.meta, new typename promise<U>::adopt_node(p));
+    }
+
+    // run user code; whatever it throws rejects p
+    template<typename U, typename Call>
+    static void settle(const std::shared_ptr<typename promise<U>::meta_t>& p, Call&& call){
+        try{
+            resolve<U>(p, call());
+        }catch(const reason_t& reason){
+            promise<U>::meta_t::reject(p, reason, true);
+        }catch(const std::exception& e){
+            promise<U>::meta_t::reject(p, reason_t(e.what()), true);
+        }catch(...){
+            promise<U>::meta_t::reject(p, reason_t("unknown reason"), true);
+        }
+    }
+
+    template<typename F, typename R, typename U>
+    struct then_node : node_t{
+        then_node(F f, R r, std::shared_ptr<typename promise<U>::meta_t> p) :
+            on_fulfilled(std::move(f)), on_rejected(std::move(r)), promise_(std::move(p)){}
+        void run(const std::shared_ptr<meta_t>& src) override{
+            if(src->is_fulfilled()){
+                const T& v=src->value(); // fan-out continuations share it
+                settle<U>(promise_, [&]{ return on_fulfilled(v); });
+            }else{
+                on_reject(on_rejected, src->reason);
+            }
+        }
+        template<typename G>
+        void on_reject(G& g, const reason_t& r){
+            settle<U>(promise_, [&]{ return g(r); });
+        }
+        void on_reject(std::nullptr_t, const reason_t& r){
+            promise<U>::meta_t::reject(promise_, r, true);
+        }
+        F on_fulfilled;
+        R on_rejected;
+        std::shared_ptr<typename promise<U>::meta_t> promise_;
+    };
+
+    // p adopts the state of the promise this node is attached to
+    struct adopt_node : node_t{
+        explicit adopt_node(std::shared_ptr<meta_t> p) : promise_(std::move(p)){}
+        void run(const std::shared_ptr<meta_t>& src) override{
+            if(src->is_fulfilled()) meta_t::fulfill(promise_, src->value(), true);
+            else meta_t::reject(promise_, src->reason, true);
+        }
+        std::shared_ptr<meta_t> promise_;
+    };
+
+    // forwards the outcome to a promise_t
+    struct bridge_node : node_t{
+        bridge_node(promise_t::fulfill_func f, promise_t::reject_func r) : fulfill(std::move(f)), reject(std::move(r)){}
+        void run(const std::shared_ptr<meta_t>& src) override{
+            if(src->is_fulfilled()) fulfill(value_t(src->value()));
+            else reject(src->reason);
+        }
+        promise_t::fulfill_func fulfill;
+        promise_t::reject_func reject;
+    };
+
+    static std::shared_ptr<meta_t> make_meta(){
+        return std::allocate_shared<meta_t>(pool_allocator<meta_t>());
+    }
+
+    explicit promise(std::shared_ptr<meta_t> m) : meta(std::move(m)){}
+    std::shared_ptr<meta_t> meta;
+};
+
+}
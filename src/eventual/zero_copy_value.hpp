@@ -25,136 +25,396 @@
 
 #pragma once
 
+#include "arena.hpp"
+#include "pool.hpp"
+#include "span.hpp"
+#include "type_id.hpp"
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
 #include <string>
-#include <typeinfo>
+#include <type_traits>
 //#include <iostream>
 
 namespace eventual{
 
+/*
+zero_copy_value holds any type without deep copies
+
+    1. small trivially-copyable payloads (int, double, pointers, small PODs up to inline_size bytes) are stored inline:
+       no allocation, no reference count; copying such a value copies its bytes, which is as cheap as sharing them
+    2. every other payload lives in a shared meta object; copies of the value share it, only copy() clones it
+    3. make_unique<T>() creates a payload owned by this one value (always on the heap), without a reference count;
+       it becomes shared when the value is first copied (or share()d), so a value that is only ever moved never touches an atomic.
+       as with any first write, do not copy a unique value from several threads at once
+    4. while an arena is current on this thread (arena::scope, or a promise chain that carries one), shared payloads are placed in it
+    5. borrow() wraps an object that lives elsewhere (e.g. in a mapped buffer) and keeps its owner alive instead of copying it
+    6. slice<C>() views a range of a contiguous payload (std::string, std::vector, ...) as an inline span<const E>,
+       and shares the parent payload's ownership: no copy, no allocation, one reference count increment per slice
+*/
 class zero_copy_value{
+    // keeps the converting ctor and assignment away from zero_copy_value itself
+    template<typename T>
+    using not_a_value = typename std::enable_if<!std::is_same<typename std::decay<T>::type, zero_copy_value>::value>::type;
 public:
+    static constexpr size_t inline_size = 2 * sizeof(void*);
+
     // empty is a valid state
-    zero_copy_value() : meta(nullptr){}
-    zero_copy_value(zero_copy_value&&d) : meta(nullptr)
+    zero_copy_value() noexcept : meta(nullptr), inline_type(nullptr), owned(nullptr){}
+    zero_copy_value(zero_copy_value&&d) noexcept : meta(nullptr), inline_type(d.inline_type)
     {
         // std::cout<<"ctor swap!\n";
         meta.swap(d.meta);
+        std::memcpy(buf, d.buf, inline_size);
+        d.inline_type=nullptr;
+        d.owned=nullptr;
     }
     // none of these ctors & operators would actually make a copy
-    zero_copy_value(const zero_copy_value& d) : meta(d.meta){
+    zero_copy_value(const zero_copy_value& d) : inline_type(d.inline_type){
         // std::cout<<"ctor ref++\n";
+        d.share_now();
+        meta=d.meta;
+        std::memcpy(buf, d.buf, inline_size);
+    }
+    ~zero_copy_value(){
+        if(is_unique()) delete owned;
     }
     // rvalue to be swapped as they would be obsolete anyway
     zero_copy_value& operator= (zero_copy_value&&d) noexcept{
         // std::cout<<"swap!\n";
-        meta.swap(d.meta);
-        return *this;
+        return swap(d);
     }
     // increment ref count without making actual copy 
-    zero_copy_value& operator= (const zero_copy_value& d) noexcept{
+    zero_copy_value& operator= (const zero_copy_value& d){
         //std::cout<<"ref++\n";
-        meta=d.meta;
-        return *this;
+        zero_copy_value shared(d);
+        return swap(shared);
     }
-    // do we refer to the same meta object?
+    // do we refer to the same meta object? 
+    // inline values have no meta object to compare: they are equal if they hold the same type and bytes (see README)
     bool operator== (const zero_copy_value& d) const noexcept{
-        return meta.get()==d.meta.get();
+        if(inline_type!=nullptr || d.inline_type!=nullptr){
+            return inline_type!=nullptr && d.inline_type!=nullptr && inline_type==d.inline_type && std::memcmp(buf, d.buf, inline_size)==0;
+        }
+        return heap()==d.heap();
     }
     bool operator!= (const zero_copy_value& d) const noexcept{
         return !(*this==d);
     }
     bool empty() const noexcept{
-        return meta==nullptr;
+        return heap()==nullptr && inline_type==nullptr;
+    }
+    // is the payload stored inline?
+    bool is_inline() const noexcept{
+        return inline_type!=nullptr;
+    }
+    // is the payload owned by this value alone, without a reference count? (see make_unique)
+    bool is_unique() const noexcept{
+        return inline_type==nullptr && owned!=nullptr;
+    }
+    // turn a unique payload into a shared one now, e.g. before handing the value to several threads
+    zero_copy_value& share(){
+        share_now();
+        return *this;
     }
     // swap values between two lvalues
-    zero_copy_value& swap(zero_copy_value& d)
+    zero_copy_value& swap(zero_copy_value& d) noexcept
     {
         meta.swap(d.meta);
+        std::swap(inline_type, d.inline_type);
+        unsigned char tmp[inline_size];
+        std::memcpy(tmp, buf, inline_size);
+        std::memcpy(buf, d.buf, inline_size);
+        std::memcpy(d.buf, tmp, inline_size);
         return *this;
     }
     // copy must be called in a very explicit way
     zero_copy_value copy()  //return a reference to another copy of *this
     {
-        return zero_copy_value(meta->copy());
+        if(inline_type!=nullptr) return *this; // copying the bytes is a deep copy already
+        return zero_copy_value(copy_tag(), heap()->copy());
+    } 
+    // construct from any type; an rvalue is moved in, not copied
+    template<typename T, typename = not_a_value<T>>
+    zero_copy_value(T&& value) : inline_type(nullptr), owned(nullptr)
+    {
+        store<typename std::decay<T>::type>(std::forward<T>(value));
     } 
-    // construct from any type
-    template<typename T>
-    zero_copy_value(const T& value) : meta(std::make_shared<meta_any_t<T>>(value))
-    {} 
     // assign any type
-    template<typename T>
-    zero_copy_value& operator=(const T& value)
+    template<typename T, typename = not_a_value<T>>
+    zero_copy_value& operator=(T&& value)
     {
         // reuse move ctor and template ctor won't introduce overhead
         // dont't use std::move to explicitly create a rvalue though 
         // std::move(zero_copy_value(value)) actually disables copy elision 
         // see https://stackoverflow.com/questions/19267408/why-does-stdmove-prevent-rvo
-        *this = zero_copy_value(value);
+        *this = zero_copy_value(std::forward<T>(value));
         // meta=std::make_shared<meta_any_t<T>>(value);
         return *this;
     }
-    // return typeid type name
+    // a value holding a T constructed in place from args
+    template<typename T, typename... Args>
+    static zero_copy_value make(Args&&... args)
+    {
+        zero_copy_value v;
+        v.store<T>(std::forward<Args>(args)...);
+        return v;
+    }
+    // like make, but the payload is owned by the returned value alone until it is first copied
+    template<typename T, typename... Args>
+    static zero_copy_value make_unique(Args&&... args)
+    {
+        zero_copy_value v;
+        v.store_unique<T>(stored_inline<T>(), std::forward<Args>(args)...);
+        return v;
+    }
+    // a value whose payload is *object, which stays where it is: owner keeps it alive, nothing is copied.
+    // copies share it like any other payload; read it in place through cref() or a const get_if(). anything that hands out
+    // a writable T (ref, get_if, mutate) first gives the value a clone of its own, so a read-only buffer is never written through
+    template<typename T>
+    static zero_copy_value borrow(T* object, std::shared_ptr<const void> owner)
+    {
+        using U=typename std::remove_const<T>::type;
+        zero_copy_value v;
+        v.meta=std::make_shared<meta_ref_t<U>>(const_cast<U*>(object), std::move(owner));
+        return v;
+    }
+    // a value holding span<const E> over elements [offset, offset+count) of this value's C payload, clipped to its end.
+    // C is anything with data(), size() and value_type E, including a span, so slices can be sliced again.
+    // the span is stored inline, and the value shares the parent's ownership (like the aliasing shared_ptr constructor),
+    // so the parent payload lives as long as its longest-living slice. throws if this value does not hold a C
+    template<class C>
+    zero_copy_value slice(size_t offset, size_t count=std::string::npos) const
+    {
+        static_assert(!stored_inline<C>::value || is_span<C>::value, "an inline payload moves with its value and cannot be sliced");
+        using E=typename std::add_const<typename C::value_type>::type;
+        const C& parent=cref<C>();
+        span<E> whole(parent.data(), parent.size());
+        zero_copy_value v(whole.subspan(offset, count));
+        share_now();
+        v.meta=meta;
+        return v;
+    }
+    // would a T be stored inline? (see inline_size)
+    template<typename T>
+    static constexpr bool stores_inline() noexcept
+    {
+        return stored_inline<T>::value;
+    }
+    // replace the payload with a T constructed in place from args
+    template<typename T, typename... Args>
+    T& emplace(Args&&... args)
+    {
+        *this = make<T>(std::forward<Args>(args)...);
+        return *payload<T>(stored_inline<T>());
+    }
+    // return typeid type name (see type_name)
     std::string type() 
     {
-        if(meta==nullptr) return std::string(typeid(nullptr).name());
-        return meta->type_name();
+        return id()->name();
+    }
+    // the type_id of the holded value, type_id<std::nullptr_t>() if empty
+    type_id_t id() const noexcept
+    {
+        if(inline_type!=nullptr) return inline_type;
+        if(heap()==nullptr) return type_id<std::nullptr_t>();
+        return heap()->id;
+    }
+    // safest way to judge the type of holded value: a single pointer compare
+    bool has_same_type(type_id_t rhs)const noexcept
+    {
+        return id()==rhs;
     }
-    // safest way to judge the type of holded value
+#ifndef EVENTUAL_NO_RTTI
     bool has_same_type(const std::type_info& rhs)const noexcept
     {
-        if(meta==nullptr) return typeid(nullptr)==rhs;
-        return meta->has_same_type(rhs);
+        const std::type_info& info=*id()->info;
+        return &info==&rhs || info==rhs;
+    }
+#endif
+    // does it hold a T? only looks where a T would be stored, and builds no strings
+    template<class T>
+    bool holds() const noexcept
+    {
+        return holds<T>(stored_inline<T>());
     }
     // recover zero_copy_value to a known type
     template<class T>
     T data()
     {
-        if(type()==typeid(T).name()){
-            //no need for dynamic_cast, since we have checked type of T matches meta's 
-            auto meta_of_T=static_cast<meta_any_t<T>*>(meta.get()); 
-            return *(meta_of_T->data());
-        }
-        else{
-            throw std::runtime_error("T is not the type holded by this zero_copy_value");
-        }
+        return cref<T>();
+    }
+    // the payload if it is a T, nullptr otherwise; no allocation, no copy (except for a borrowed payload, see borrow)
+    template<class T>
+    T* get_if()
+    {
+        T* p=find<T>();
+        if(p!=nullptr && inline_type==nullptr && owned==nullptr && meta->borrowed) p=own(p);
+        return p;
+    }
+    template<class T>
+    const T* get_if() const noexcept
+    {
+        return find<T>();
+    }
+    // the payload by reference; throws if it is not a T. 
+    // a shared payload is shared with every copy of this value, so only mutate it through ref if none of them minds (or use mutate)
+    template<class T>
+    T& ref()
+    {
+        T* p=get_if<T>();
+        if(p==nullptr) throw std::runtime_error("T is not the type holded by this zero_copy_value");
+        return *p;
+    }
+    template<class T>
+    const T& cref() const
+    {
+        const T* p=find<T>();
+        if(p==nullptr) throw std::runtime_error("T is not the type holded by this zero_copy_value");
+        return *p;
+    }
+    // the payload for writing, copy-on-write: if other values share it, this one first gets a clone of its own
+    // (a unique one, see make_unique), so they never see the change; otherwise it is modified in place
+    template<class T>
+    T& mutate()
+    {
+        T* p=&ref<T>();
+        if(inline_type==nullptr && owned==nullptr && meta.use_count()>1) p=own(p);
+        return *p;
     }
 private:
     class meta_t{
     public:
-        virtual std::string type_name()=0;
+        meta_t(type_id_t id, void* object, bool borrowed) noexcept : id(id), object(object), borrowed(borrowed){}
+        virtual ~meta_t(){}
         virtual std::shared_ptr<meta_t> copy()=0;
-        virtual bool has_same_type(const std::type_info& rhs)const noexcept=0;
+        const type_id_t id;
+        void* const object;     // the payload, wherever it lives
+        const bool borrowed;    // the payload is not ours to write (see borrow)
     };
 
     // this ctor is only used to create a copy
-    zero_copy_value(std::shared_ptr<meta_t> meta):meta(meta){}
+    struct copy_tag{};
+    zero_copy_value(copy_tag, std::shared_ptr<meta_t> meta):meta(std::move(meta)), inline_type(nullptr), owned(nullptr){}
 
     template <typename T>
     class meta_any_t : public meta_t{
     public:
-        meta_any_t(const T& v): value(v) {}
-        // note that there is a small chance that two different types share the same name
-        std::string type_name() override{
-            return std::string(typeid(T).name()); 
-        }
+        template<typename... Args>
+        explicit meta_any_t(Args&&... args): meta_t(type_id<T>(), &value, false), value(std::forward<Args>(args)...) {}
         std::shared_ptr<meta_t> copy() override{
             return std::make_shared<meta_any_t<T>>(value);
         }
-        // safest way to judge T's type
-        bool has_same_type(const std::type_info& rhs) const noexcept override
-        {
-            return typeid(T)==rhs;
-        }
-        // cannot return value here
-        T* data()
-        {
-            return &value;
-        }
     private:
         T value;
     };
-    std::shared_ptr<meta_t> meta;
+
+    // a payload that lives outside, kept alive by its owner
+    template <typename T>
+    class meta_ref_t : public meta_t{
+    public:
+        meta_ref_t(T* object, std::shared_ptr<const void> owner) noexcept
+            : meta_t(type_id<T>(), object, true), owner(std::move(owner)){}
+        std::shared_ptr<meta_t> copy() override{
+            return std::make_shared<meta_any_t<T>>(*static_cast<T*>(object));
+        }
+    private:
+        std::shared_ptr<const void> owner;
+    };
+
+    template<typename T>
+    bool holds(std::true_type) const noexcept
+    {
+        return inline_type==type_id<T>();
+    }
+    template<typename T>
+    bool holds(std::false_type) const noexcept
+    {
+        return heap()!=nullptr && heap()->id==type_id<T>();
+    }
+
+    // whether T is kept in buf rather than in a meta object
+    template<typename T>
+    using stored_inline = std::integral_constant<bool, 
+        std::is_trivially_copyable<T>::value && sizeof(T)<=inline_size && alignof(T)<=alignof(void*)>;
+
+    template<typename T, typename... Args>
+    void store(Args&&... args)
+    {
+        store_as<T>(stored_inline<T>(), std::forward<Args>(args)...);
+    }
+    template<typename T, typename... Args>
+    void store_as(std::true_type, Args&&... args)
+    {
+        std::memset(buf, 0, inline_size); // == compares all of buf: the bytes a T does not cover must be the same too
+        new (buf) T(std::forward<Args>(args)...);
+        inline_type=type_id<T>();
+    }
+    template<typename T, typename... Args>
+    void store_as(std::false_type, Args&&... args)
+    {
+        if(arena* a=arena::current()){
+            meta=std::allocate_shared<meta_any_t<T>>(arena_allocator<meta_any_t<T>>(*a), std::forward<Args>(args)...);
+            return;
+        }
+        meta=std::make_shared<meta_any_t<T>>(std::forward<Args>(args)...);
+    }
+    template<typename T, typename... Args>
+    void store_unique(std::true_type, Args&&... args)
+    {
+        store_as<T>(std::true_type(), std::forward<Args>(args)...); // no reference count to avoid
+    }
+    template<typename T, typename... Args>
+    void store_unique(std::false_type, Args&&... args)
+    {
+        owned=new meta_any_t<T>(std::forward<Args>(args)...);
+    }
+    // the meta object, shared or owned; nullptr if empty or inline
+    meta_t* heap() const noexcept
+    {
+        if(inline_type!=nullptr) return nullptr;
+        return owned!=nullptr ? owned : meta.get();
+    }
+    // logically const: the payload stays the same, only its ownership becomes shared;
+    // the control block comes from the thread-caching pool
+    void share_now() const
+    {
+        if(!is_unique()) return;
+        meta=std::shared_ptr<meta_t>(owned, std::default_delete<meta_t>(), pool_allocator<meta_t>());
+        owned=nullptr;
+    }
+    // p, which this value shares, is not ours to write: replace it with a unique clone (see make_unique)
+    template<typename T>
+    T* own(T* p)
+    {
+        owned=new meta_any_t<T>(*p);
+        meta.reset();
+        return payload<T>(std::false_type());
+    }
+    template<typename T>
+    T* find() const noexcept
+    {
+        return holds<T>() ? const_cast<zero_copy_value*>(this)->payload<T>(stored_inline<T>()) : nullptr;
+    }
+    template<typename T>
+    T* payload(std::true_type) noexcept
+    {
+        return reinterpret_cast<T*>(buf);
+    }
+    template<typename T>
+    T* payload(std::false_type) noexcept
+    {
+        //no need for dynamic_cast, since we have checked type of T matches meta's 
+        return static_cast<T*>(heap()->object);
+    }
+
+    mutable std::shared_ptr<meta_t> meta;   // with an inline payload, set only for slices: the parent it keeps alive
+    type_id_t inline_type;               // the type stored in buf, nullptr if none
+    union{
+        alignas(void*) unsigned char buf[inline_size];
+        mutable meta_t* owned;          // a unique payload, if inline_type is nullptr
+    };
 };
 
 }
-
@@ -0,0 +1,118 @@
+#include "gtest/gtest.h"
+#include "arena.hpp"
+#include "promise.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace eventual;
+// testcase: test_arena
+class test_arena : public ::testing::Test {
+protected:
+	test_arena() {
+
+	}
+
+	virtual ~test_arena() {
+
+	}
+
+	virtual void SetUp() {
+		// Code here will be called immediately after the constructor (right
+		// before each test).
+
+
+	}
+
+	virtual void TearDown() {
+		// Code here will be called immediately after each test (right
+		// before the destructor).
+
+
+	}
+
+	// wait (at most a few seconds) until pred holds
+	template <class Pred>
+	static bool eventually(Pred pred) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (!pred()) {
+			if (std::chrono::steady_clock::now() > deadline) return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+};
+
+
+// testcase: test_arena
+// testname: allocate
+TEST_F(test_arena, allocate) {
+	arena a(1024);
+	EXPECT_EQ(0u, a.chunks());
+	void* p = a.allocate(10, 1);
+	void* q = a.allocate(8, 64);
+	EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(q) % 64);
+	EXPECT_NE(p, q);
+	EXPECT_EQ(1u, a.chunks());
+	a.allocate(4096); // bigger than a chunk
+	EXPECT_EQ(2u, a.chunks());
+	// many threads at once
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&]{ for (int i = 0; i < 1000; i++) *static_cast<int*>(a.allocate(sizeof(int))) = i; });
+	}
+	for (auto& t : threads) t.join();
+	EXPECT_GE(a.used(), 4000 * sizeof(int));
+}
+
+// testcase: test_arena
+// testname: scoped_values
+TEST_F(test_arena, scoped_values) {
+	auto a = std::make_shared<arena>();
+	std::weak_ptr<arena> alive = a;
+	zero_copy_value outside(std::string("heap"));
+	zero_copy_value kept;
+	{
+		arena::scope in(a);
+		EXPECT_EQ(a.get(), arena::current());
+		zero_copy_value v(std::vector<int>(10, 1));
+		kept = zero_copy_value(std::string(100, 'x'));
+		zero_copy_value small(1); // inline, nothing to allocate
+		EXPECT_GT(a->used(), 0u);
+	}
+	EXPECT_EQ(nullptr, arena::current());
+	size_t used = a->used();
+	zero_copy_value later(std::string(100, 'y'));
+	EXPECT_EQ(used, a->used());
+	// a value still in use keeps the arena's memory, not the arena
+	a.reset();
+	EXPECT_TRUE(alive.expired());
+	EXPECT_EQ(std::string(100, 'x'), kept.cref<std::string>());
+	zero_copy_value shared = kept;
+	kept = zero_copy_value();
+	EXPECT_EQ(std::string(100, 'x'), shared.cref<std::string>());
+}
+
+// testcase: test_arena
+// testname: promise_chain
+TEST_F(test_arena, promise_chain) {
+	auto a = std::make_shared<arena>();
+	std::weak_ptr<arena> alive = a;
+	std::atomic<bool> done{false};
+	{
+		promise_t::fulfill_func fulfill;
+		promise_t p([&](promise_t::fulfill_func f, promise_t::reject_func){ fulfill = f; }, a);
+		p.then([](value_t){ return value_t(std::string(64, 'a')); }, nullptr)
+		 .then([](value_t v){ return value_t(v.cref<std::string>() + "b"); }, nullptr)
+		 .then([&](value_t v){ done = v.cref<std::string>().size() == 65; return value_t(); }, nullptr);
+		fulfill(value_t(0));
+		EXPECT_TRUE(eventually([&]{ return done.load(); }));
+	}
+	EXPECT_GT(a->used(), 0u);
+	a.reset();
+	// released in one go once the chain is gone
+	EXPECT_TRUE(eventually([&]{ return alive.expired(); }));
+}
@@ -0,0 +1,122 @@
+#include "gtest/gtest.h"
+#include "atomic_value.hpp"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace eventual;
+// testcase: test_atomic_value
+class test_atomic_value : public ::testing::Test {
+protected:
+	test_atomic_value() {
+
+	}
+
+	virtual ~test_atomic_value() {
+
+	}
+
+	virtual void SetUp() {
+		// Code here will be called immediately after the constructor (right
+		// before each test).
+
+
+	}
+
+	virtual void TearDown() {
+		// Code here will be called immediately after each test (right
+		// before the destructor).
+
+
+	}
+
+};
+
+// counts live instances to check that every snapshot is reclaimed exactly once
+struct config {
+	static std::atomic<int> alive;
+	std::vector<int> fields;
+	explicit config(int version) : fields(16, version) { alive++; }
+	config(const config& c) : fields(c.fields) { alive++; }
+	~config() { alive--; }
+	bool consistent() const {
+		for (int f : fields) if (f != fields[0]) return false;
+		return true;
+	}
+};
+std::atomic<int> config::alive(0);
+
+// testcase: test_atomic_value
+// testname: load_store
+TEST_F(test_atomic_value, load_store) {
+	atomic_value cell(std::string("a"));
+	EXPECT_EQ("a", cell.load().cref<std::string>());
+	zero_copy_value held = cell.load();
+	cell.store(std::string("b"));
+	EXPECT_EQ("b", cell.load().cref<std::string>());
+	EXPECT_EQ("a", held.cref<std::string>()); // a loaded copy shares the payload and outlives the snapshot
+	EXPECT_EQ(1u, cell.read([](const zero_copy_value& v) { return v.cref<std::string>().size(); }));
+	EXPECT_EQ(0u, cell.pending());
+	atomic_value empty;
+	EXPECT_TRUE(empty.load().empty());
+}
+
+// testcase: test_atomic_value
+// testname: deferred_reclamation
+TEST_F(test_atomic_value, deferred_reclamation) {
+	{
+		atomic_value cell(zero_copy_value::make<config>(1));
+		cell.read([&](const zero_copy_value& v) {
+			cell.store(zero_copy_value::make<config>(2));
+			// this reader may still use the old snapshot, so it is kept
+			EXPECT_EQ(1u, cell.pending());
+			EXPECT_EQ(1, v.cref<config>().fields[0]);
+			EXPECT_EQ(2, config::alive.load());
+			return 0;
+		});
+		cell.reclaim();
+		EXPECT_EQ(0u, cell.pending());
+		EXPECT_EQ(1, config::alive.load());
+	}
+	EXPECT_EQ(0, config::alive.load());
+}
+
+// testcase: test_atomic_value
+// testname: concurrent
+TEST_F(test_atomic_value, concurrent) {
+	{
+		atomic_value cell(zero_copy_value::make<config>(0));
+		std::atomic<bool> stop(false);
+		std::atomic<long> reads(0), torn(0);
+		std::vector<std::thread> readers;
+		for (int t = 0; t < 4; t++) {
+			readers.emplace_back([&] {
+				int last = 0;
+				while (!stop.load()) {
+					cell.read([&](const zero_copy_value& v) {
+						const config& c = v.cref<config>();
+						if (!c.consistent() || c.fields[0] < last) torn++;
+						last = c.fields[0];
+						return 0;
+					});
+					zero_copy_value copy = cell.load();
+					if (!copy.cref<config>().consistent()) torn++;
+					reads++;
+				}
+			});
+		}
+		for (int version = 1; version <= 2000; version++) {
+			cell.store(zero_copy_value::make<config>(version));
+			if (version % 100 == 0) std::this_thread::yield();
+		}
+		stop = true;
+		for (auto& t : readers) t.join();
+		EXPECT_EQ(0, torn.load());
+		EXPECT_GT(reads.load(), 0);
+		cell.reclaim();
+		EXPECT_EQ(0u, cell.pending());
+		EXPECT_EQ(1, config::alive.load());
+	}
+	EXPECT_EQ(0, config::alive.load());
+}
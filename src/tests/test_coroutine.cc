@@ -0,0 +1,136 @@
+#include "gtest/gtest.h"
+#include "coroutine.hpp"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+// coroutine support needs a C++20 build (cmake -Dcxx20=ON -Dtest=ON)
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+using namespace eventual;
+// testcase: test_coroutine
+class test_coroutine : public ::testing::Test {
+protected:
+	test_coroutine() {
+
+	}
+
+	virtual ~test_coroutine() {
+
+	}
+
+	virtual void SetUp() {
+		// Code here will be called immediately after the constructor (right
+		// before each test).
+
+
+	}
+
+	virtual void TearDown() {
+		// Code here will be called immediately after each test (right
+		// before the destructor).
+
+
+	}
+
+	// wait (at most a few seconds) until pred holds
+	template <class Pred>
+	static bool eventually(Pred pred) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (!pred()) {
+			if (std::chrono::steady_clock::now() > deadline) return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+};
+
+static async<int> add(promise_t a, promise_t b)
+{
+	value_t x = co_await a;
+	value_t y = co_await b;
+	co_return x.data<int>() + y.data<int>();
+}
+
+static async<std::string> describe(promise_t a, promise_t b)
+{
+	int sum = co_await add(a, b);
+	co_return std::to_string(sum);
+}
+
+
+// testcase: test_coroutine
+// testname: await_promise
+TEST_F(test_coroutine, await_promise) {
+	promise_t::fulfill_func fulfill;
+	promise_t pending([&](promise_t::fulfill_func f, promise_t::reject_func){ fulfill = f; });
+	std::atomic<int> result{0};
+	add(promise_t::create_fulfilled_promise(value_t(1)), pending).start()
+		.then([&](value_t v){ result = v.data<int>(); return v; }, nullptr);
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	EXPECT_EQ(0, result.load());
+	fulfill(value_t(41));
+	EXPECT_TRUE(eventually([&]{ return result.load() == 42; }));
+}
+
+// testcase: test_coroutine
+// testname: await_async
+TEST_F(test_coroutine, await_async) {
+	std::atomic<bool> done{false};
+	describe(promise_t::delay(std::chrono::milliseconds(5), value_t(20)), promise_t::create_fulfilled_promise(value_t(3))).start()
+		.then([&](value_t v){ done = (v.data<std::string>() == "23"); return v; }, nullptr);
+	EXPECT_TRUE(eventually([&]{ return done.load(); }));
+}
+
+static async<void> fail(promise_t p)
+{
+	co_await p;
+}
+
+static async<int> recover(promise_t p)
+{
+	try {
+		co_await fail(p);
+	} catch (const reason_t& r) {
+		co_return (int)r.size();
+	}
+	co_return 0;
+}
+
+// testcase: test_coroutine
+// testname: rejection
+TEST_F(test_coroutine, rejection) {
+	// a rejected promise throws its reason into the coroutine, which can catch it or pass it on
+	std::atomic<int> caught{0};
+	recover(promise_t::create_rejected_promise(reason_t("four"))).start()
+		.then([&](value_t v){ caught += v.data<int>(); return v; }, nullptr);
+	fail(promise_t::create_rejected_promise(reason_t("x"))).start()
+		.then(nullptr, [&](reason_t r){ caught += (r == "x") ? 10 : 0; return value_t(); });
+	EXPECT_TRUE(eventually([&]{ return caught.load() == 14; }));
+}
+
+static async<int> count_down(int n)
+{
+	int sum = 0;
+	for (int i = n; i > 0; i--) sum += (co_await promise_t::create_fulfilled_promise(value_t(1))).data<int>();
+	co_return sum;
+}
+
+static async<int> deep(int n)
+{
+	if (n == 0) co_return 0;
+	co_return 1 + co_await deep(n - 1);
+}
+
+// testcase: test_coroutine
+// testname: no_suspension_when_settled
+TEST_F(test_coroutine, no_suspension_when_settled) {
+	// settled promises are read in place and nested coroutines transfer symmetrically: neither grows the stack nor hops queues
+	std::atomic<int> result{0};
+	count_down(100000).start().then([&](value_t v){ result += v.data<int>(); return v; }, nullptr);
+	deep(10000).start().then([&](value_t v){ result += v.data<int>(); return v; }, nullptr);
+	EXPECT_TRUE(eventually([&]{ return result.load() == 110000; }));
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "gtest/gtest.h"
+#include "pool.hpp"
+#include "promise.h"
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace eventual;
+// testcase: test_pool
+class test_pool : public ::testing::Test {
+protected:
+	test_pool() {
+
+	}
+
+	virtual ~test_pool() {
+
+	}
+
+	virtual void SetUp() {
+		// Code here will be called immediately after the constructor (right
+		// before each test).
+
+
+	}
+
+	virtual void TearDown() {
+		// Code here will be called immediately after each test (right
+		// before the destructor).
+
+
+	}
+};
+
+
+// testcase: test_pool
+// testname: reuse_on_same_thread
+TEST_F(test_pool, reuse_on_same_thread) {
+	void* a = pool::allocate(40);
+	pool::deallocate(a);
+	void* b = pool::allocate(40);
+	EXPECT_EQ(a, b);
+	pool::deallocate(b);
+}
+
+// testcase: test_pool
+// testname: large_blocks
+TEST_F(test_pool, large_blocks) {
+	pool::stats_t before = pool::stats();
+	void* p = pool::allocate(4096);
+	pool::deallocate(p);
+	EXPECT_EQ(before.large + 1, pool::stats().large);
+}
+
+// testcase: test_pool
+// testname: remote_free_returns_to_owner
+TEST_F(test_pool, remote_free_returns_to_owner) {
+	// drain this thread's free list of the class so that the next refill must come from the remote list
+	std::vector<void*> mine;
+	for (size_t i = 0; i < pool::blocks_per_slab * 2; i++) mine.push_back(pool::allocate(100));
+	pool::stats_t before = pool::stats();
+	std::thread([&]{
+		for (void* p : mine) pool::deallocate(p);
+	}).join();
+	EXPECT_EQ(before.remote_frees + mine.size(), pool::stats().remote_frees);
+	// the owner gets its blocks back instead of asking the system for a new slab
+	std::vector<void*> again;
+	for (size_t i = 0; i < mine.size(); i++) again.push_back(pool::allocate(100));
+	EXPECT_EQ(before.slabs, pool::stats().slabs);
+	for (void* p : again) pool::deallocate(p);
+}
+
+// testcase: test_pool
+// testname: allocate_shared
+TEST_F(test_pool, allocate_shared) {
+	pool::stats_t before = pool::stats();
+	{
+		auto p = std::allocate_shared<std::vector<int>>(pool_allocator<std::vector<int>>(), 3, 7);
+		EXPECT_EQ(7, (*p)[2]);
+	}
+	pool::stats_t after = pool::stats();
+	EXPECT_EQ(before.allocations + 1, after.allocations);
+	EXPECT_EQ(before.deallocations + 1, after.deallocations);
+}
+
+// testcase: test_pool
+// testname: promise_uses_pool
+TEST_F(test_pool, promise_uses_pool) {
+	pool::stats_t before = pool::stats();
+	{
+		promise_t p = promise_t::create_fulfilled_promise(value_t(1));
+	}
+	EXPECT_LT(before.allocations, pool::stats().allocations);
+}
@@ -0,0 +1,346 @@
+#include "gtest/gtest.h"
+#include "promise.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace eventual;
+// testcase: test_promise
+class test_promise : public ::testing::Test {
+protected:
+	test_promise() {
+
+	}
+
+	virtual ~test_promise() {
+
+	}
+
+	virtual void SetUp() {
+		// Code here will be called immediately after the constructor (right
+		// before each test).
+
+
+	}
+
+	virtual void TearDown() {
+		// Code here will be called immediately after each test (right
+		// before the destructor).
+
+
+	}
+
+	// wait (at most a few seconds) until pred holds
+	template <class Pred>
+	static bool eventually(Pred pred) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (!pred()) {
+			if (std::chrono::steady_clock::now() > deadline) return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+};
+
+
+// testcase: test_promise
+// testname: then_on_pending
+TEST_F(test_promise, then_on_pending) {
+	promise_t::fulfill_func fulfill;
+	promise_t p([&](promise_t::fulfill_func f, promise_t::reject_func){ fulfill = f; });
+	std::atomic<int> result{0};
+	p.then([](value_t v){ return value_t(v.data<int>() + 1); }, nullptr)
+	 .then([&](value_t v){ result = v.data<int>(); return v; }, nullptr);
+	fulfill(value_t(41));
+	EXPECT_TRUE(eventually([&]{ return result.load() == 42; }));
+}
+
+// testcase: test_promise
+// testname: then_on_settled
+TEST_F(test_promise, then_on_settled) {
+	std::atomic<int> result{0};
+	promise_t::create_fulfilled_promise(value_t(7))
+		.then([&](value_t v){ result = v.data<int>(); return v; }, nullptr);
+	promise_t::create_rejected_promise(reason_t("no"))
+		.then(nullptr, [&](reason_t r){ result += (int)r.size(); return value_t(); });
+	EXPECT_TRUE(eventually([&]{ return result.load() == 9; }));
+}
+
+// testcase: test_promise
+// testname: rejection_propagates
+TEST_F(test_promise, rejection_propagates) {
+	std::atomic<bool> caught{false};
+	promise_t::create_fulfilled_promise(value_t(1))
+		.then([](value_t) -> value_t { throw reason_t("boom"); }, nullptr)
+		.then([](value_t v){ return v; }, nullptr)
+		.then(nullptr, [&](reason_t r){ caught = (r == "boom"); return value_t(); });
+	EXPECT_TRUE(eventually([&]{ return caught.load(); }));
+}
+
+// testcase: test_promise
+// testname: adopt_promise
+TEST_F(test_promise, adopt_promise) {
+	promise_t::fulfill_func fulfill;
+	promise_t inner([&](promise_t::fulfill_func f, promise_t::reject_func){ fulfill = f; });
+	std::atomic<int> result{0};
+	promise_t::create_fulfilled_promise(value_t(1))
+		.then([inner](value_t){ return value_t(inner); }, nullptr)
+		.then([&](value_t v){ result = v.data<int>(); return v; }, nullptr);
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	EXPECT_EQ(0, result.load());
+	fulfill(value_t(5));
+	EXPECT_TRUE(eventually([&]{ return result.load() == 5; }));
+}
+
+// testcase: test_promise
+// testname: concurrent_then_and_fulfill
+TEST_F(test_promise, concurrent_then_and_fulfill) {
+	// every continuation must run exactly once, whether it was added before or after settling
+	for (int round = 0; round < 20; round++) {
+		promise_t::fulfill_func fulfill;
+		promise_t p([&](promise_t::fulfill_func f, promise_t::reject_func){ fulfill = f; });
+		std::atomic<int> calls{0};
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; t++) {
+			threads.emplace_back([&]{
+				for (int i = 0; i < 50; i++) {
+					p.then([&](value_t v){ calls++; return v; }, nullptr);
+				}
+			});
+		}
+		fulfill(value_t(round));
+		for (auto& t : threads) t.join();
+		EXPECT_TRUE(eventually([&]{ return calls.load() == 200; }));
+	}
+}
+
+// testcase: test_promise
+// testname: inline_continuations
+TEST_F(test_promise, inline_continuations) {
+	// a pre-built chain is trampolined on the worker that settles its head
+	promise_engine::instance().set_inline_budget(64, std::chrono::seconds(1));
+	promise_t::fulfill_func fulfill;
+	promise_t p([&](promise_t::fulfill_func f, promise_t::reject_func){ fulfill = f; });
+	std::vector<std::thread::id> ids(10);
+	std::atomic<int> done{0};
+	promise_t q = p;
+	for (int i = 0; i < 10; i++) {
+		q = q.then([&, i](value_t v){ ids[i] = std::this_thread::get_id(); return v; }, nullptr);
+	}
+	q.then([&](value_t v){ done++; return v; }, nullptr);
+	fulfill(value_t(0));
+	EXPECT_TRUE(eventually([&]{ return done.load() == 1; }));
+	for (int i = 1; i < 10; i++) EXPECT_EQ(ids[0], ids[i]);
+	EXPECT_NE(std::this_thread::get_id(), ids[0]);
+
+	// no budget: every link goes through the queue, and the chain still completes
+	promise_engine::instance().set_inline_budget(0, std::chrono::seconds(1));
+	promise_t r([&](promise_t::fulfill_func f, promise_t::reject_func){ fulfill = f; });
+	q = r;
+	for (int i = 0; i < 10; i++) q = q.then([](value_t v){ return v; }, nullptr);
+	q.then([&](value_t v){ done++; return v; }, nullptr);
+	fulfill(value_t(0));
+	EXPECT_TRUE(eventually([&]{ return done.load() == 2; }));
+	promise_engine::instance().set_inline_budget(32, std::chrono::microseconds(50));
+}
+
+// testcase: test_promise
+// testname: settle_then_wait_in_continuation
+TEST_F(test_promise, settle_then_wait_in_continuation) {
+	// fulfill is nonblocking inside a continuation too: a callback may settle a promise and wait for its successor
+	promise_engine::instance().set_inline_budget(64, std::chrono::seconds(1));
+	std::atomic<int> result{0};
+	promise_t::create_fulfilled_promise(value_t(0)).then([&](value_t v){
+		promise_t::fulfill_func fulfill;
+		promise_t p([&](promise_t::fulfill_func f, promise_t::reject_func){ fulfill = f; });
+		std::atomic<int> inner{0};
+		p.then([&](value_t x){ inner = x.data<int>(); return x; }, nullptr);
+		fulfill(value_t(7));
+		eventually([&]{ return inner.load() != 0; });
+		result = inner.load();
+		return v;
+	}, nullptr);
+	EXPECT_TRUE(eventually([&]{ return result.load() != 0; }));
+	EXPECT_EQ(7, result.load());
+	promise_engine::instance().set_inline_budget(32, std::chrono::microseconds(50));
+}
+
+// testcase: test_promise
+// testname: all
+TEST_F(test_promise, all) {
+	std::vector<promise_t::fulfill_func> fulfills(100);
+	std::vector<promise_t> inputs;
+	for (size_t i = 0; i < fulfills.size(); i++) {
+		inputs.emplace_back([&, i](promise_t::fulfill_func f, promise_t::reject_func){ fulfills[i] = f; });
+	}
+	std::atomic<long> sum{-1};
+	promise_t::all(inputs).then([&](value_t v){
+		long s = 0;
+		auto values = v.data<std::vector<value_t>>();
+		for (size_t i = 0; i < values.size(); i++) s += values[i].data<int>() * (long)i;
+		sum = s;
+		return v;
+	}, nullptr);
+	// settle out of order; results still come back in input order
+	for (size_t i = fulfills.size(); i > 0; i--) fulfills[i - 1](value_t(1));
+	EXPECT_TRUE(eventually([&]{ return sum.load() == 4950; }));
+
+	std::atomic<bool> rejected{false};
+	promise_t::all({promise_t::create_fulfilled_promise(value_t(1)), promise_t::create_rejected_promise(reason_t("x"))})
+		.then(nullptr, [&](reason_t r){ rejected = (r == "x"); return value_t(); });
+	EXPECT_TRUE(eventually([&]{ return rejected.load(); }));
+}
+
+// testcase: test_promise
+// testname: any_and_race
+TEST_F(test_promise, any_and_race) {
+	promise_t pending([](promise_t::fulfill_func, promise_t::reject_func){});
+	std::atomic<int> any_result{0}, race_result{0};
+	std::atomic<bool> race_rejected{false}, any_rejected{false};
+	promise_t::any({promise_t::create_rejected_promise(reason_t("a")), pending, promise_t::create_fulfilled_promise(value_t(3))})
+		.then([&](value_t v){ any_result = v.data<int>(); return v; }, nullptr);
+	promise_t::race({pending, promise_t::create_rejected_promise(reason_t("b"))})
+		.then(nullptr, [&](reason_t){ race_rejected = true; return value_t(); });
+	promise_t::race({promise_t::create_fulfilled_promise(value_t(4)), pending})
+		.then([&](value_t v){ race_result = v.data<int>(); return v; }, nullptr);
+	promise_t::any({promise_t::create_rejected_promise(reason_t("c")), promise_t::create_rejected_promise(reason_t("d"))})
+		.then(nullptr, [&](reason_t){ any_rejected = true; return value_t(); });
+	EXPECT_TRUE(eventually([&]{ return any_result.load() == 3 && race_result.load() == 4; }));
+	EXPECT_TRUE(eventually([&]{ return race_rejected.load() && any_rejected.load(); }));
+}
+
+// testcase: test_promise
+// testname: all_settled
+TEST_F(test_promise, all_settled) {
+	std::atomic<int> fulfilled{-1};
+	promise_t::all_settled({promise_t::create_fulfilled_promise(value_t(1)), promise_t::create_rejected_promise(reason_t("x")), promise_t::create_fulfilled_promise(value_t(2))})
+		.then([&](value_t v){
+			auto results = v.data<std::vector<promise_t::settled_t>>();
+			int n = 0;
+			for (auto& r : results) n += r.fulfilled ? 1 : 0;
+			if (results[1].reason == "x") fulfilled = n;
+			return v;
+		}, nullptr);
+	EXPECT_TRUE(eventually([&]{ return fulfilled.load() == 2; }));
+}
+
+// testcase: test_promise
+// testname: large_fan_in
+TEST_F(test_promise, large_fan_in) {
+	std::vector<promise_t> inputs;
+	for (int i = 0; i < 100000; i++) inputs.push_back(promise_t::create_fulfilled_promise(value_t(i)));
+	std::atomic<size_t> size{0};
+	promise_t::all(inputs).then([&](value_t v){ size = v.data<std::vector<value_t>>().size(); return value_t(); }, nullptr);
+	EXPECT_TRUE(eventually([&]{ return size.load() == 100000; }));
+}
+
+// testcase: test_promise
+// testname: cancellation
+TEST_F(test_promise, cancellation) {
+	// cancelling skips every queued continuation of the chain; successors inherit the token, rejection handlers included
+	cancellation_source source;
+	promise_t::fulfill_func fulfill;
+	promise_t p([&](promise_t::fulfill_func f, promise_t::reject_func){ fulfill = f; }, source.token());
+	std::atomic<int> ran{0};
+	promise_t q = p.then([&](value_t v){ ran++; return v; }, nullptr)
+	 .then([&](value_t v){ ran++; return v; }, nullptr)
+	 .then(nullptr, [&](reason_t r){ ran++; return value_t(r); });
+	source.cancel();
+	fulfill(value_t(1));
+	// a combinator's output carries no token, so it observes the cancelled tail
+	std::atomic<bool> cancelled{false};
+	promise_t::all_settled({q}).then([&](value_t v){
+		auto results = v.data<std::vector<promise_t::settled_t>>();
+		cancelled = !results[0].fulfilled && results[0].reason == promise_t::cancelled_reason();
+		return v;
+	}, nullptr);
+	EXPECT_TRUE(eventually([&]{ return cancelled.load(); }));
+	EXPECT_EQ(0, ran.load());
+
+	// a promise created with a cancelled token never runs its init
+	bool initialized = false;
+	promise_t late([&](promise_t::fulfill_func f, promise_t::reject_func){ initialized = true; f(value_t(1)); }, source.token());
+	EXPECT_FALSE(initialized);
+
+	// without cancelling, the token changes nothing
+	cancellation_source other;
+	promise_t r([](promise_t::fulfill_func f, promise_t::reject_func){ f(value_t(2)); }, other.token());
+	r.then([&](value_t v){ ran = v.data<int>(); return v; }, nullptr);
+	EXPECT_TRUE(eventually([&]{ return ran.load() == 2; }));
+}
+
+// testcase: test_promise
+// testname: delay_and_timeout
+TEST_F(test_promise, delay_and_timeout) {
+	auto start = std::chrono::steady_clock::now();
+	std::atomic<int> result{0};
+	promise_t::delay(std::chrono::milliseconds(30), value_t(3))
+		.then([&](value_t v){ result = v.data<int>(); return v; }, nullptr);
+	EXPECT_TRUE(eventually([&]{ return result.load() == 3; }));
+	EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(30));
+
+	// the deadline wins
+	promise_t never([](promise_t::fulfill_func, promise_t::reject_func){});
+	std::atomic<bool> timed_out{false};
+	never.timeout(std::chrono::milliseconds(10))
+		.then(nullptr, [&](reason_t r){ timed_out = (r == promise_t::timeout_reason()); return value_t(); });
+	EXPECT_TRUE(eventually([&]{ return timed_out.load(); }));
+
+	// the promise wins; its value and rejection pass through
+	std::atomic<int> passed{0};
+	promise_t::delay(std::chrono::milliseconds(5), value_t(4)).timeout(std::chrono::seconds(10))
+		.then([&](value_t v){ passed += v.data<int>(); return v; }, nullptr);
+	promise_t::create_rejected_promise(reason_t("x")).timeout(std::chrono::seconds(10))
+		.then(nullptr, [&](reason_t r){ passed += (r == "x") ? 10 : 0; return value_t(); });
+	EXPECT_TRUE(eventually([&]{ return passed.load() == 14; }));
+
+	// a cancellation before the deadline is reported as one
+	cancellation_source source;
+	promise_t::fulfill_func fulfill;
+	promise_t p([&](promise_t::fulfill_func f, promise_t::reject_func){ fulfill = f; }, source.token());
+	std::atomic<bool> cancelled{false};
+	promise_t t = p.then([](value_t v){ return v; }, nullptr).timeout(std::chrono::seconds(10));
+	promise_t::all_settled({t}).then([&](value_t v){
+		auto results = v.data<std::vector<promise_t::settled_t>>();
+		cancelled = !results[0].fulfilled && results[0].reason == promise_t::cancelled_reason();
+		return v;
+	}, nullptr);
+	source.cancel();
+	fulfill(value_t(1));
+	EXPECT_TRUE(eventually([&]{ return cancelled.load(); }));
+}
+
+// testcase: test_promise
+// testname: fulfill_without_copy
+TEST_F(test_promise, fulfill_without_copy) {
+	// a buffer moved into fulfill reaches the continuation as the very same allocation
+	std::vector<char> buffer(10 << 20);
+	const char* address = buffer.data();
+	promise_t::fulfill_func fulfill;
+	promise_t p([&](promise_t::fulfill_func f, promise_t::reject_func){ fulfill = f; });
+	std::atomic<bool> same{false};
+	p.then([&](value_t v){ same = (v.cref<std::vector<char>>().data() == address); return v; }, nullptr);
+	fulfill(std::move(buffer));
+	EXPECT_TRUE(eventually([&]{ return same.load(); }));
+}
+
+// testcase: test_promise
+// testname: unique_value_passes_through
+TEST_F(test_promise, unique_value_passes_through) {
+	// the middle link of a chain is reachable only from its predecessor, so its only continuation gets the value unshared
+	promise_t::fulfill_func fulfill;
+	promise_t p([&](promise_t::fulfill_func f, promise_t::reject_func){ fulfill = f; });
+	std::atomic<int> unique{-1};
+	p.then([](value_t){ return zero_copy_value::make_unique<std::vector<int>>(1000, 1); }, nullptr)
+	 .then([&](value_t v){ unique = v.is_unique() ? 1 : 0; return v; }, nullptr);
+	fulfill(value_t(0));
+	EXPECT_TRUE(eventually([&]{ return unique.load() == 1; }));
+
+	// a promise with two continuations shares it
+	std::atomic<int> shared{0};
+	promise_t q = promise_t::create_fulfilled_promise(zero_copy_value::make_unique<std::string>("s"));
+	q.then([&](value_t v){ shared += v.is_unique() ? 0 : 1; return v; }, nullptr);
+	q.then([&](value_t v){ shared += v.is_unique() ? 0 : 1; return v; }, nullptr);
+	EXPECT_TRUE(eventually([&]{ return shared.load() == 2; }));
+}
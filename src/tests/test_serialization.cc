@@ -0,0 +1,152 @@
+#include "gtest/gtest.h"
+#include "serialization.hpp"
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace eventual;
+
+struct sample { double x[8]; int n; };
+
+// registered once for the whole process, as an application would at startup
+static void register_types() {
+	static bool once = [] {
+		type_registry& r = type_registry::instance();
+		r.add<int>(1);
+		r.add<sample>(2);
+		r.add<std::string>(3,
+			[](const std::string& s, void* out, size_t cap) {
+				if (cap >= s.size()) std::memcpy(out, s.data(), s.size());
+				return s.size();
+			},
+			[](const void* data, size_t size, const std::shared_ptr<const void>&) {
+				return zero_copy_value(std::string(static_cast<const char*>(data), size));
+			});
+		return true;
+	}();
+	(void)once;
+}
+
+// testcase: test_serialization
+class test_serialization : public ::testing::Test {
+protected:
+	test_serialization() {
+
+	}
+
+	virtual ~test_serialization() {
+
+	}
+
+	virtual void SetUp() {
+		// Code here will be called immediately after the constructor (right
+		// before each test).
+		register_types();
+
+	}
+
+	virtual void TearDown() {
+		// Code here will be called immediately after each test (right
+		// before the destructor).
+
+
+	}
+
+};
+
+// testcase: test_serialization
+// testname: round_trip
+TEST_F(test_serialization, round_trip) {
+	type_registry& r = type_registry::instance();
+	std::vector<unsigned char> buf(256);
+	sample s{};
+	s.x[7] = 2.5;
+	s.n = 42;
+	std::vector<zero_copy_value> values{zero_copy_value(7), zero_copy_value(s), zero_copy_value(std::string("hello")), zero_copy_value()};
+	size_t at = 0;
+	for (auto& v : values) {
+		size_t n = r.serialize(v, buf.data() + at, buf.size() - at);
+		EXPECT_EQ(r.serialized_size(v), n);
+		EXPECT_EQ(0u, n % type_registry::record_align);
+		at += n;
+	}
+	// records are read back in order, copying since there is no owner
+	size_t read = 0, n = 0;
+	EXPECT_EQ(7, r.deserialize(buf.data(), at, nullptr, &n).cref<int>());
+	read += n;
+	zero_copy_value b = r.deserialize(buf.data() + read, at - read, nullptr, &n);
+	read += n;
+	EXPECT_EQ(42, b.cref<sample>().n);
+	EXPECT_EQ(2.5, b.cref<sample>().x[7]);
+	EXPECT_EQ("hello", r.deserialize(buf.data() + read, at - read, nullptr, &n).cref<std::string>());
+	read += n;
+	EXPECT_TRUE(r.deserialize(buf.data() + read, at - read, nullptr, &n).empty());
+	read += n;
+	EXPECT_EQ(at, read);
+}
+
+// testcase: test_serialization
+// testname: zero_copy
+TEST_F(test_serialization, zero_copy) {
+	type_registry& r = type_registry::instance();
+	sample s{};
+	s.n = 5;
+	auto region = std::make_shared<std::vector<uint64_t>>(32); // stands in for a mapped region
+	unsigned char* base = reinterpret_cast<unsigned char*>(region->data());
+	r.serialize(zero_copy_value(s), base, region->size() * sizeof(uint64_t));
+
+	zero_copy_value v = r.deserialize(base, region->size() * sizeof(uint64_t), region);
+	const zero_copy_value& cv = v;
+	const sample* p = cv.get_if<sample>();
+	ASSERT_NE(nullptr, p);
+	EXPECT_EQ(static_cast<const void*>(base + sizeof(record_header)), static_cast<const void*>(p)); // the payload in place
+	EXPECT_EQ(2, region.use_count()); // kept alive by the value
+	reinterpret_cast<sample*>(base + sizeof(record_header))->n = 6;
+	EXPECT_EQ(6, v.cref<sample>().n);
+
+	// mutate and copy never write through to the buffer
+	zero_copy_value w = v;
+	w.mutate<sample>().n = 9;
+	EXPECT_EQ(6, v.cref<sample>().n);
+	EXPECT_EQ(9, w.cref<sample>().n);
+	EXPECT_NE(static_cast<const void*>(base), static_cast<const void*>(v.copy().get_if<sample>()));
+
+	// so do ref and a writable get_if: the value gets a clone first, and the buffer keeps what it had
+	zero_copy_value x = v;
+	x.ref<sample>().n = 10;
+	EXPECT_EQ(6, v.cref<sample>().n);
+	EXPECT_EQ(10, x.cref<sample>().n);
+	x = v;
+	x.get_if<sample>()->n = 11;
+	EXPECT_EQ(6, reinterpret_cast<sample*>(base + sizeof(record_header))->n);
+	EXPECT_EQ(p, cv.get_if<sample>()); // reading never clones
+	x = zero_copy_value();
+
+	// inline-sized payloads are copied anyway
+	r.serialize(zero_copy_value(3), base, 64);
+	EXPECT_TRUE(r.deserialize(base, 64, region).is_inline());
+
+	v = zero_copy_value();
+	w = zero_copy_value();
+	EXPECT_EQ(1, region.use_count());
+}
+
+// testcase: test_serialization
+// testname: errors
+TEST_F(test_serialization, errors) {
+	type_registry& r = type_registry::instance();
+	unsigned char buf[64] = {};
+	struct unknown { int a; };
+	EXPECT_FALSE(r.registered(type_id<unknown>()));
+	EXPECT_TRUE(r.registered(type_id<int>()));
+	EXPECT_THROW(r.serialize(zero_copy_value(unknown{1}), buf, sizeof(buf)), std::runtime_error);
+	EXPECT_THROW(r.serialize(zero_copy_value(sample{}), buf, sizeof(buf)), std::length_error);
+	EXPECT_THROW(r.add<long>(1), std::logic_error);
+	EXPECT_THROW(r.add<int>(9), std::logic_error);
+
+	size_t n = r.serialize(zero_copy_value(std::string("abc")), buf, sizeof(buf));
+	EXPECT_THROW(r.deserialize(buf, n - 8, nullptr), std::runtime_error); // truncated payload
+	buf[0] = 99;
+	EXPECT_THROW(r.deserialize(buf, n, nullptr), std::runtime_error); // unknown id
+}
@@ -0,0 +1,79 @@
+#include "gtest/gtest.h"
+#include "static_todo.hpp"
+#include <thread>
+#include <vector>
+
+using namespace eventual;
+// testcase: test_static_todo
+class test_static_todo : public ::testing::Test {
+protected:
+	test_static_todo() {
+
+	}
+
+	virtual ~test_static_todo() {
+
+	}
+
+	virtual void SetUp() {
+		// Code here will be called immediately after the constructor (right
+		// before each test).
+
+
+	}
+
+	virtual void TearDown() {
+		// Code here will be called immediately after each test (right
+		// before the destructor).
+
+
+	}
+
+};
+
+// providers complete on their own thread, after the step has returned
+static void provide(todo_context* self, bool ok) {
+	std::thread([self, ok] {
+		if (ok) self->resolve();
+		else self->reject();
+		self->wake();
+	}).detach();
+}
+
+// testcase: test_static_todo
+// testname: chain
+TEST_F(test_static_todo, chain) {
+	std::vector<int> trace;
+	auto job = [&](int id, bool ok) {
+		return [&trace, id, ok](todo_context* self) { trace.push_back(id); provide(self, ok); };
+	};
+	auto err = [&](int id) {
+		return [&trace, id](todo_context* self) { trace.push_back(id); self->finish(); self->wake(); };
+	};
+	make_todo(job(0, true))(job(1, true))(job(2, true))(job(3, false))(job(4, true), err(-3))[err(-4)]();
+	EXPECT_EQ((std::vector<int>{0, 1, 2, 3, -3}), trace);
+
+	trace.clear();
+	make_todo(job(0, true))(job(1, true))(job(2, false), err(-1))[err(-2)]();
+	EXPECT_EQ((std::vector<int>{0, 1, 2, -2}), trace);
+
+	// a step without on_resolve ends a resolved chain, as with todo
+	trace.clear();
+	make_todo(job(0, true))(nullptr, err(-1))(job(2, true))();
+	EXPECT_EQ((std::vector<int>{0}), trace);
+}
+
+// testcase: test_static_todo
+// testname: reuse
+TEST_F(test_static_todo, reuse) {
+	int runs = 0;
+	auto inline_job = [&runs](todo_context* self) { runs++; self->resolve(); self->wake(); };
+	auto chain = make_todo(inline_job)(inline_job);
+	auto longer = chain(inline_job); // a named builder is copied, not consumed
+	chain();
+	EXPECT_EQ(2, runs);
+	longer.run();
+	EXPECT_EQ(5, runs);
+	auto pending = make_todo([](todo_context* self) { self->wake(); })(inline_job);
+	EXPECT_THROW(pending(), std::runtime_error);
+}
@@ -0,0 +1,115 @@
+#include "gtest/gtest.h"
+#include "task.hpp"
+#include "zero_copy_value.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+// count heap allocations made while a test asks for it
+static std::atomic<bool> counting{false};
+static std::atomic<size_t> nr_allocations{0};
+
+void* operator new(size_t size)
+{
+	if (counting.load(std::memory_order_relaxed)) nr_allocations++;
+	void* p = std::malloc(size ? size : 1);
+	if (p == nullptr) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+using namespace eventual;
+// testcase: test_task
+class test_task : public ::testing::Test {
+protected:
+	test_task() {
+
+	}
+
+	virtual ~test_task() {
+
+	}
+
+	virtual void SetUp() {
+		// Code here will be called immediately after the constructor (right
+		// before each test).
+		nr_allocations = 0;
+
+	}
+
+	virtual void TearDown() {
+		// Code here will be called immediately after each test (right
+		// before the destructor).
+		counting = false;
+
+	}
+};
+
+
+// testcase: test_task
+// testname: ctor
+TEST_F(test_task, ctor) {
+	task t;
+	EXPECT_FALSE((bool)t);
+	EXPECT_THROW(t(), std::bad_function_call);
+	int i = 0;
+	t = [&i]{ i++; };
+	EXPECT_TRUE((bool)t);
+	t();
+	EXPECT_EQ(1, i);
+}
+
+// testcase: test_task
+// testname: move_only
+TEST_F(test_task, move_only) {
+	auto p = std::make_unique<int>(41);
+	task t([p = std::move(p)]{ (*p)++; });
+	task u(std::move(t));
+	EXPECT_FALSE((bool)t);
+	u();
+	task w;
+	w = std::move(u);
+	EXPECT_FALSE((bool)u);
+	w();
+}
+
+// testcase: test_task
+// testname: no_allocation_for_continuations
+TEST_F(test_task, no_allocation_for_continuations) {
+	// roughly what promise_t dispatches: two callbacks, a promise and a value
+	std::function<zero_copy_value(zero_copy_value)> f = [](zero_copy_value v){ return v; };
+	std::function<zero_copy_value(std::string)> r = [](std::string){ return zero_copy_value(); };
+	auto meta = std::make_shared<int>(0);
+	zero_copy_value v(1);
+	int calls = 0;
+	counting = true;
+	task t([f = std::move(f), r = std::move(r), meta, v, &calls]() mutable{ calls++; });
+	task u(std::move(t));
+	u();
+	u = nullptr;
+	counting = false;
+	EXPECT_EQ(1, calls);
+	EXPECT_EQ(0u, nr_allocations.load());
+}
+
+// testcase: test_task
+// testname: large_callable
+TEST_F(test_task, large_callable) {
+	char big[task::inline_size * 2] = {1};
+	int sum = 0;
+	task t([big, &sum]{ sum += big[0]; });
+	EXPECT_FALSE(t.is_inline());
+	task u(std::move(t));
+	u();
+	EXPECT_EQ(1, sum);
+}
@@ -0,0 +1,83 @@
+#include "gtest/gtest.h"
+#include "threadpool.hpp"
+#include "stealing_threadpool.hpp"
+#include <atomic>
+#include <thread>
+
+using namespace eventual;
+// testcase: test_threadpool
+class test_threadpool : public ::testing::Test {
+protected:
+	test_threadpool() {
+
+	}
+
+	virtual ~test_threadpool() {
+
+	}
+
+	virtual void SetUp() {
+		// Code here will be called immediately after the constructor (right
+		// before each test).
+
+
+	}
+
+	virtual void TearDown() {
+		// Code here will be called immediately after each test (right
+		// before the destructor).
+
+
+	}
+
+	template <class Pool>
+	size_t run_fanout(Pool& pool, size_t roots, size_t fanout) {
+		std::atomic<size_t> done{0};
+		for (size_t i = 0; i < roots; i++) {
+			pool.run([&]{
+				for (size_t k = 0; k < fanout; k++) {
+					pool.run([&]{ done++; });
+				}
+				done++;
+			});
+		}
+		while (done.load() != roots * (1 + fanout)) std::this_thread::yield();
+		return done.load();
+	}
+};
+
+
+// testcase: test_threadpool
+// testname: locked_queue
+TEST_F(test_threadpool, locked_queue) {
+	threadpool pool(4);
+	EXPECT_EQ(1000u * 5, run_fanout(pool, 1000, 4));
+}
+
+// testcase: test_threadpool
+// testname: work_stealing
+TEST_F(test_threadpool, work_stealing) {
+	stealing_threadpool pool(4);
+	EXPECT_EQ(4u, pool.size());
+	EXPECT_EQ(1000u * 5, run_fanout(pool, 1000, 4));
+}
+
+// testcase: test_threadpool
+// testname: steal_from_busy_worker
+TEST_F(test_threadpool, steal_from_busy_worker) {
+	stealing_threadpool pool(4);
+	std::atomic<size_t> done{0};
+	std::atomic<bool> release{false};
+	std::atomic<bool> exited{false};
+	// one worker keeps its own deque full and blocks; the others must steal to finish
+	pool.run([&]{
+		for (int i = 0; i < 100; i++) pool.run([&]{ done++; });
+		while (!release.load()) std::this_thread::yield();
+		exited = true;
+	});
+	while (done.load() != 100) std::this_thread::yield();
+	release = true;
+	// the blocked task reads release: it must be gone before the locals are
+	while (!exited.load()) std::this_thread::yield();
+	EXPECT_EQ(100u, done.load());
+}
@@ -0,0 +1,146 @@
+#include "gtest/gtest.h"
+#include "timer.hpp"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace eventual;
+using namespace std::chrono;
+// testcase: test_timer
+class test_timer : public ::testing::Test {
+protected:
+	test_timer() : timers([](task t){ t(); }) {
+
+	}
+
+	virtual ~test_timer() {
+
+	}
+
+	virtual void SetUp() {
+		// Code here will be called immediately after the constructor (right
+		// before each test).
+
+
+	}
+
+	virtual void TearDown() {
+		// Code here will be called immediately after each test (right
+		// before the destructor).
+
+
+	}
+
+	// wait (at most a few seconds) until pred holds
+	template <class Pred>
+	static bool eventually(Pred pred) {
+		auto deadline = steady_clock::now() + seconds(5);
+		while (!pred()) {
+			if (steady_clock::now() > deadline) return false;
+			std::this_thread::sleep_for(milliseconds(1));
+		}
+		return true;
+	}
+
+	// runs expired tasks right on the timer thread
+	timer_service timers;
+};
+
+
+// testcase: test_timer
+// testname: fires_in_order
+TEST_F(test_timer, fires_in_order) {
+	std::mutex mtx;
+	std::vector<int> order;
+	auto start = steady_clock::now();
+	std::vector<steady_clock::duration> late(3);
+	for (int i : {3, 1, 2}) {
+		timers.schedule(start + milliseconds(20 * i), [&, i]{
+			std::lock_guard<std::mutex> lk(mtx);
+			late[i - 1] = steady_clock::now() - (start + milliseconds(20 * i));
+			order.push_back(i);
+		});
+	}
+	EXPECT_TRUE(eventually([&]{ std::lock_guard<std::mutex> lk(mtx); return order.size() == 3; }));
+	EXPECT_EQ((std::vector<int>{1, 2, 3}), order);
+	for (auto d : late) EXPECT_GE(d.count(), 0); // never early
+	EXPECT_EQ(0u, timers.size());
+}
+
+// testcase: test_timer
+// testname: cancel
+TEST_F(test_timer, cancel) {
+	std::atomic<int> fired{0};
+	timer_id a = timers.schedule_after(milliseconds(10), [&]{ fired += 1; });
+	timer_id b = timers.schedule_after(milliseconds(10), [&]{ fired += 10; });
+	EXPECT_TRUE(timers.cancel(a));
+	EXPECT_FALSE(timers.cancel(a));
+	EXPECT_FALSE(timers.cancel(timer_id()));
+	EXPECT_TRUE(eventually([&]{ return fired.load() == 10; }));
+	// b's node may already serve another timer; its stale id must not cancel that one
+	timer_id c = timers.schedule_after(milliseconds(10), [&]{ fired += 100; });
+	EXPECT_FALSE(timers.cancel(b));
+	EXPECT_TRUE(eventually([&]{ return fired.load() == 110; }));
+	EXPECT_FALSE(timers.cancel(c));
+}
+
+// testcase: test_timer
+// testname: cascade
+TEST_F(test_timer, cascade) {
+	// deadlines beyond the first level (256 ticks) are cascaded down before they fire
+	std::atomic<int> fired{0};
+	auto start = steady_clock::now();
+	std::atomic<long> elapsed{0};
+	timers.schedule(start + milliseconds(700), [&]{
+		elapsed = (long)duration_cast<milliseconds>(steady_clock::now() - start).count();
+		fired++;
+	});
+	timer_id far = timers.schedule(start + hours(24 * 100), [&]{ fired++; }); // parked in the last level
+	EXPECT_TRUE(eventually([&]{ return fired.load() == 1; }));
+	EXPECT_GE(elapsed.load(), 700);
+	EXPECT_EQ(1u, timers.size());
+	EXPECT_TRUE(timers.cancel(far));
+}
+
+// testcase: test_timer
+// testname: shutdown_waits_for_handover
+TEST_F(test_timer, shutdown_waits_for_handover) {
+	// the executor may use whatever owns the service until the destructor returns, and never after
+	std::atomic<bool> entered{false}, left{false};
+	{
+		timer_service slow([&](task t) {
+			entered = true;
+			std::this_thread::sleep_for(milliseconds(50));
+			t();
+			left = true;
+		});
+		slow.schedule_after(milliseconds(0), []{});
+		EXPECT_TRUE(eventually([&]{ return entered.load(); }));
+	}
+	EXPECT_TRUE(left.load());
+}
+
+// testcase: test_timer
+// testname: many_timers
+TEST_F(test_timer, many_timers) {
+	const int n = 200000;
+	std::atomic<int> fired{0};
+	std::mt19937 rng(7);
+	std::uniform_int_distribution<int> ms(0, 600);
+	std::vector<timer_id> ids;
+	ids.reserve(n);
+	// the half cancelled below is due no earlier than 2s, so it is still pending however slowly the rest is scheduled
+	for (int i = 0; i < n; i++) {
+		milliseconds due(ms(rng) + (i % 2 == 0 ? 2000 : 0));
+		ids.push_back(timers.schedule_after(due, [&]{ fired++; }));
+	}
+	int cancelled = 0;
+	for (int i = 0; i < n; i += 2) cancelled += timers.cancel(ids[i]) ? 1 : 0;
+	// size() drops before the executor has run the expired batch
+	EXPECT_TRUE(eventually([&]{ return fired.load() + cancelled == n; }));
+	EXPECT_EQ(0u, timers.size());
+	EXPECT_EQ(n / 2, cancelled);
+}
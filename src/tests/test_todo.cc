@@ -1,5 +1,12 @@
 #include "gtest/gtest.h"
 #include "todo.hpp"
+#include "threadpool.hpp"
+#include <atomic>
+#include <future>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 using namespace eventual;
 // testcase: test_todo
@@ -52,3 +59,143 @@ TEST_F(test_todo, operator_eq) {
 	EXPECT_EQ(1, i);
 }
 
+
+// a provider that completes on a pool thread, as a network or disk service would
+static void provide(const std::shared_ptr<threadpool>& pool, todo self, bool ok) {
+	pool->run([self, ok]() mutable {
+		if (ok) self.resolve();
+		else self.reject();
+		self.wake();
+	});
+}
+
+// testcase: test_todo
+// testname: run_async
+TEST_F(test_todo, run_async) {
+	// pools are shared with the chains: a thread may still be inside run() after the last step has finished
+	auto pool = std::make_shared<threadpool>(2);
+	auto on_pool = [pool](task t) { pool->run(std::move(t)); };
+	std::vector<int> trace;
+	std::promise<int> done;
+	todo{[&](todo* self) { trace.push_back(0); provide(pool, *self, true); }}
+	([&](todo* self) { trace.push_back(1); provide(pool, *self, true); })
+	([&](todo* self) { trace.push_back(2); provide(pool, *self, false); })
+	([&](todo* self) { trace.push_back(3); provide(pool, *self, true); },
+	 [&](todo* self) { trace.push_back(-2); self->finish(); self->wake(); })
+	([&](todo* self) { trace.push_back(4); provide(pool, *self, true); })
+	.run_async(on_pool, [&](todo* self) { done.set_value(self->get_state()); });
+	EXPECT_EQ(todo::finished, done.get_future().get());
+	EXPECT_EQ((std::vector<int>{0, 1, 2, -2}), trace);
+}
+
+// testcase: test_todo
+// testname: run_after_run_async
+TEST_F(test_todo, run_after_run_async) {
+	// once run_async has finished, the same todo runs blocking: wake() no longer goes to the executor
+	auto pool = std::make_shared<threadpool>(2);
+	std::atomic<int> scheduled(0);
+	auto on_pool = [pool, &scheduled](task t) { scheduled++; pool->run(std::move(t)); };
+	std::atomic<int> steps(0);
+	todo t{[&](todo* self) { steps++; provide(pool, *self, true); }};
+	t([&](todo* self) { steps++; provide(pool, *self, true); });
+	std::promise<void> done;
+	t.run_async(on_pool, [&](todo*) { done.set_value(); });
+	done.get_future().wait();
+	int async_scheduled = scheduled.load();
+	t.run();
+	EXPECT_EQ(4, steps.load());
+	EXPECT_EQ(todo::finished, t.get_state());
+	EXPECT_EQ(async_scheduled, scheduled.load());
+}
+
+// testcase: test_todo
+// testname: many_in_flight
+TEST_F(test_todo, many_in_flight) {
+	// far more chains than threads: none of them holds a thread while its provider works
+	const int n = 20000;
+	auto pool = std::make_shared<threadpool>(4), services = std::make_shared<threadpool>(2);
+	auto on_pool = [pool](task t) { pool->run(std::move(t)); };
+	std::atomic<int> finished(0), steps(0);
+	std::promise<void> all;
+	auto step = [&steps, services](todo* self) { steps++; provide(services, *self, true); };
+	for (int i = 0; i < n; i++) {
+		todo{step}(step)(step).run_async(on_pool, [&](todo*) {
+			if (++finished == n) all.set_value();
+		});
+	}
+	all.get_future().wait();
+	EXPECT_EQ(3 * n, steps.load());
+}
+
+// testcase: test_todo
+// testname: parallel
+TEST_F(test_todo, parallel) {
+	auto pool = std::make_shared<threadpool>(3);
+	std::atomic<int> started(0);
+	auto fetch = [&started, pool](bool ok) {
+		return [&started, pool, ok](todo* self) { started++; provide(pool, *self, ok); };
+	};
+	auto count = [](int& n) {
+		return [&n](todo* self) { n++; self->resolve(); self->wake(); };
+	};
+	// download three files at once, then unzip
+	int unzipped = 0, failed = 0;
+	todo{fetch(true)}.parallel({fetch(true), fetch(true), fetch(true)}).then(count(unzipped))();
+	EXPECT_EQ(4, started.load());
+	EXPECT_EQ(1, unzipped);
+
+	// fail_fast: one rejection is enough to go on, to the next step's on_reject
+	todo{fetch(true)}.parallel({fetch(true), fetch(false), fetch(true)}).then(count(unzipped), count(failed))();
+	EXPECT_EQ(1, failed);
+	EXPECT_EQ(1, unzipped);
+
+	// any: one success is enough
+	todo{fetch(true)}.parallel({fetch(false), fetch(true)}, nullptr, todo::join_policy::any)(count(unzipped), count(failed))();
+	EXPECT_EQ(2, unzipped);
+	todo{fetch(true)}.parallel({fetch(false), fetch(false)}, nullptr, todo::join_policy::any)[count(failed)]();
+	EXPECT_EQ(2, failed);
+
+	// all: waits for every job, then rejects since one did; runs asynchronously as well
+	std::promise<int> done;
+	std::atomic<int> arrived(0);
+	auto slow_ok = [&arrived, pool](todo* self) {
+		pool->run([self = *self, &arrived]() mutable {
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			arrived++;
+			self.resolve();
+			self.wake();
+		});
+	};
+	auto fast_fail = [&arrived](todo* self) { arrived++; self->reject(); self->wake(); };
+	todo{fetch(true)}.parallel({slow_ok, fast_fail}, nullptr, todo::join_policy::all)(nullptr, [&](todo* self) {
+		done.set_value(arrived.load());
+		self->finish();
+		self->wake();
+	}).run_async([pool](task t) { pool->run(std::move(t)); });
+	EXPECT_EQ(2, done.get_future().get());
+
+	// an empty group resolves at once
+	todo{fetch(true)}.parallel({}).then(count(unzipped))();
+	EXPECT_EQ(3, unzipped);
+}
+
+// testcase: test_todo
+// testname: complete
+TEST_F(test_todo, complete) {
+	// providers on another thread complete in one call; the runner may or may not have parked by then
+	int steps = 0;
+	auto job = [&steps](todo* self) {
+		steps++;
+		std::thread([t = *self]() mutable { t.complete(todo::resolved); }).detach();
+	};
+	auto fail = [](todo* self) {
+		std::thread([t = *self]() mutable { t.complete(todo::rejected); }).detach();
+	};
+	int handled = 0;
+	todo chain{job};
+	for (int i = 0; i < 200; i++) chain(job);
+	chain(fail)(job, [&handled](todo* self) { handled++; self->complete(todo::finished); })();
+	EXPECT_EQ(201, steps);
+	EXPECT_EQ(1, handled);
+	EXPECT_EQ(todo::finished, chain.get_state());
+}
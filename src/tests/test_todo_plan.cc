@@ -0,0 +1,118 @@
+#include "gtest/gtest.h"
+#include "todo_plan.hpp"
+#include "threadpool.hpp"
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace eventual;
+// testcase: test_todo_plan
+class test_todo_plan : public ::testing::Test {
+protected:
+	test_todo_plan() {
+
+	}
+
+	virtual ~test_todo_plan() {
+
+	}
+
+	virtual void SetUp() {
+		// Code here will be called immediately after the constructor (right
+		// before each test).
+
+
+	}
+
+	virtual void TearDown() {
+		// Code here will be called immediately after each test (right
+		// before the destructor).
+
+
+	}
+
+};
+
+// a provider that completes on a pool thread
+static void provide(const std::shared_ptr<threadpool>& pool, todo_run self, bool ok) {
+	pool->run([self, ok]() mutable {
+		if (ok) self.resolve();
+		else self.reject();
+		self.wake();
+	});
+}
+
+// testcase: test_todo_plan
+// testname: run
+TEST_F(test_todo_plan, run) {
+	auto pool = std::make_shared<threadpool>(2);
+	std::mutex mtx;
+	std::vector<int> trace;
+	auto job = [&, pool](int id, bool ok) {
+		return [&, pool, id, ok](todo_run* self) {
+			{ std::lock_guard<std::mutex> lk(mtx); trace.push_back(id); }
+			provide(pool, *self, ok);
+		};
+	};
+	todo_plan plan([pool](task t) { pool->run(std::move(t)); }, job(0, true));
+	plan(job(1, true))(job(2, false))(job(3, true), [&](todo_run* self) {
+		{ std::lock_guard<std::mutex> lk(mtx); trace.push_back(-2); }
+		self->finish();
+		self->wake();
+	})(job(4, true));
+	EXPECT_EQ(4u, plan.size());
+	for (int round = 0; round < 2; round++) {
+		trace.clear();
+		std::promise<int> done;
+		plan.run([&](todo_run* self) { done.set_value(self->get_state()); });
+		EXPECT_EQ(todo::finished, done.get_future().get());
+		EXPECT_EQ((std::vector<int>{0, 1, 2, -2}), trace);
+	}
+}
+
+// testcase: test_todo_plan
+// testname: pooled_runs
+TEST_F(test_todo_plan, pooled_runs) {
+	const int n = 20000;
+	auto pool = std::make_shared<threadpool>(4), services = std::make_shared<threadpool>(2);
+	std::atomic<int> steps(0), finished(0);
+	std::promise<void> all;
+	auto step = [&steps, services](todo_run* self) { steps++; provide(services, *self, true); };
+	todo_plan plan([pool](task t) { pool->run(std::move(t)); }, step);
+	plan(step)(step);
+	pool::stats_t before = pool::stats();
+	for (int i = 0; i < n; i++) {
+		plan.run([&](todo_run*) {
+			if (++finished == n) all.set_value();
+		});
+	}
+	all.get_future().wait();
+	EXPECT_EQ(3 * n, steps.load());
+	EXPECT_EQ(before.large, pool::stats().large); // every run came from a size class
+	EXPECT_GE(pool::stats().allocations - before.allocations, (uint64_t)n);
+}
+
+// testcase: test_todo_plan
+// testname: copy_on_write
+TEST_F(test_todo_plan, copy_on_write) {
+	std::vector<todo_run> parked; // runs whose provider never answers
+	auto park = [&](todo_run* self) { parked.push_back(*self); };
+	auto inline_executor = [](task t) { t(); };
+	todo_plan plan(inline_executor, park);
+	plan.run();
+	ASSERT_EQ(1u, parked.size());
+	plan(park); // the parked run keeps the plan it started with
+	EXPECT_EQ(1u, plan.size());
+	parked[0].resolve();
+	parked[0].wake(); // the old plan has no more steps
+	EXPECT_EQ(todo::finished, parked[0].get_state());
+	EXPECT_EQ(1u, parked.size());
+
+	plan.run(); // new runs see the new step
+	ASSERT_EQ(2u, parked.size());
+	parked[1].resolve();
+	parked[1].wake();
+	EXPECT_EQ(3u, parked.size());
+}
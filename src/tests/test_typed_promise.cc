@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+#include "typed_promise.hpp"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace eventual;
+// testcase: test_typed_promise
+class test_typed_promise : public ::testing::Test {
+protected:
+	test_typed_promise() {
+
+	}
+
+	virtual ~test_typed_promise() {
+
+	}
+
+	virtual void SetUp() {
+		// Code here will be called immediately after the constructor (right
+		// before each test).
+
+
+	}
+
+	virtual void TearDown() {
+		// Code here will be called immediately after each test (right
+		// before the destructor).
+
+
+	}
+
+	// wait (at most a few seconds) until pred holds
+	template <class Pred>
+	static bool eventually(Pred pred) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (!pred()) {
+			if (std::chrono::steady_clock::now() > deadline) return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+};
+
+
+// testcase: test_typed_promise
+// testname: then_deduces_type
+TEST_F(test_typed_promise, then_deduces_type) {
+	std::atomic<int> result{0};
+	promise<int>::fulfill_func fulfill;
+	promise<int> p([&](promise<int>::fulfill_func f, promise<int>::reject_func){ fulfill = f; });
+	promise<std::string> s = p.then([](const int& i){ return std::to_string(i * 2); });
+	promise<size_t> n = s.then([](const std::string& str){ return str.size(); });
+	n.then([&](size_t len){ result = (int)len; return 0; });
+	fulfill(500);
+	EXPECT_TRUE(eventually([&]{ return result.load() == 4; }));
+}
+
+// testcase: test_typed_promise
+// testname: rejection_and_recovery
+TEST_F(test_typed_promise, rejection_and_recovery) {
+	std::atomic<int> result{0};
+	promise<double>::create_fulfilled_promise(1.5)
+		.then([](double) -> double { throw reason_t("bad input"); })
+		.then([](double d){ return d; })
+		.then([](double d){ return (int)d; }, [](reason_t r){ return (int)r.size(); })
+		.then([&](int i){ result = i; return i; });
+	EXPECT_TRUE(eventually([&]{ return result.load() == 9; }));
+}
+
+// testcase: test_typed_promise
+// testname: adopt_promise
+TEST_F(test_typed_promise, adopt_promise) {
+	std::atomic<int> result{0};
+	promise<int>::create_fulfilled_promise(20)
+		.then([](int i){ return promise<int>::create_fulfilled_promise(i + 1); })
+		.then([&](int i){ result = i; return i; });
+	EXPECT_TRUE(eventually([&]{ return result.load() == 21; }));
+}
+
+// testcase: test_typed_promise
+// testname: settle_then_wait_in_continuation
+TEST_F(test_typed_promise, settle_then_wait_in_continuation) {
+	std::atomic<int> result{0};
+	promise<int>::create_fulfilled_promise(0).then([&](int i){
+		promise<int>::fulfill_func fulfill;
+		promise<int> p([&](promise<int>::fulfill_func f, promise<int>::reject_func){ fulfill = f; });
+		std::atomic<int> inner{0};
+		p.then([&](int x){ inner = x; return x; });
+		fulfill(7);
+		eventually([&]{ return inner.load() != 0; });
+		result = inner.load();
+		return i;
+	});
+	EXPECT_TRUE(eventually([&]{ return result.load() != 0; }));
+	EXPECT_EQ(7, result.load());
+}
+
+// testcase: test_typed_promise
+// testname: no_copies
+TEST_F(test_typed_promise, no_copies) {
+	// the payload is built once and read by reference
+	struct counted {
+		explicit counted(std::atomic<int>* c) : copies(c) {}
+		counted(const counted& d) : copies(d.copies) { (*copies)++; }
+		counted(counted&& d) noexcept : copies(d.copies) {}
+		std::atomic<int>* copies;
+	};
+	std::atomic<int> copies{0};
+	std::atomic<bool> done{false};
+	promise<counted>::create_fulfilled_promise(counted(&copies))
+		.then([&](const counted&){ done = true; return 0; });
+	EXPECT_TRUE(eventually([&]{ return done.load(); }));
+	EXPECT_EQ(0, copies.load());
+}
+
+// testcase: test_typed_promise
+// testname: interop
+TEST_F(test_typed_promise, interop) {
+	std::atomic<int> result{0};
+	promise_t untyped = promise<int>::create_fulfilled_promise(3).to_promise_t();
+	promise<int>::from(untyped.then([](value_t v){ return value_t(v.data<int>() * 10); }, nullptr))
+		.then([&](int i){ result = i; return i; });
+	EXPECT_TRUE(eventually([&]{ return result.load() == 30; }));
+
+	std::atomic<bool> rejected{false};
+	promise<int>::from(promise_t::create_fulfilled_promise(value_t(std::string("not an int"))))
+		.then([](int i){ return i; }, [&](reason_t){ rejected = true; return 0; });
+	EXPECT_TRUE(eventually([&]{ return rejected.load(); }));
+}
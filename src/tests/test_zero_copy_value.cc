@@ -1,5 +1,8 @@
 #include "gtest/gtest.h"
 #include "zero_copy_value.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
 
 using namespace eventual;
 class test_zero_copy_value : public ::testing::Test {
@@ -48,3 +51,226 @@ TEST_F(test_zero_copy_value, operator_eq) {
 
 
 
+
+// testcase: test_zero_copy_value
+// testname: inline_storage
+TEST_F(test_zero_copy_value, inline_storage) {
+	struct pod { int a; float b; };
+	struct big { char bytes[64]; };
+	EXPECT_TRUE(zero_copy_value(1).is_inline());
+	EXPECT_TRUE(zero_copy_value(1.5).is_inline());
+	EXPECT_TRUE(zero_copy_value(pod{1, 2.f}).is_inline());
+	EXPECT_FALSE(zero_copy_value(big{}).is_inline());
+	EXPECT_FALSE(zero_copy_value(std::string("s")).is_inline());
+	EXPECT_FALSE(x.is_inline());
+	EXPECT_TRUE(x.empty());
+	EXPECT_EQ(2.f, zero_copy_value(pod{1, 2.f}).data<pod>().b);
+}
+
+// both representations must behave the same through copy, swap, has_same_type and data
+template <class T>
+static void check_semantics(const T& a, const T& b) {
+	zero_copy_value v(a), w(b);
+	EXPECT_TRUE(v.has_same_type(type_id<T>()));
+	EXPECT_FALSE(v.has_same_type(type_id<char>()));
+	zero_copy_value shared = v;
+	EXPECT_TRUE(shared == v);
+	zero_copy_value copied = v.copy();
+	EXPECT_TRUE(copied.data<T>() == a);
+	v.swap(w);
+	EXPECT_TRUE(v.data<T>() == b);
+	EXPECT_TRUE(w.data<T>() == a);
+	zero_copy_value moved(std::move(v));
+	EXPECT_TRUE(v.empty());
+	EXPECT_TRUE(moved.data<T>() == b);
+	EXPECT_THROW(moved.data<char>(), std::runtime_error);
+}
+
+// testcase: test_zero_copy_value
+// testname: same_semantics
+TEST_F(test_zero_copy_value, same_semantics) {
+	check_semantics<int>(1, 2);
+	check_semantics<double>(1.5, 2.5);
+	check_semantics<std::string>("a", "b");
+	check_semantics<std::vector<int>>({1}, {2, 3});
+	// an inline value and a shared one swap too
+	zero_copy_value i(1), s(std::string("s"));
+	i.swap(s);
+	EXPECT_EQ("s", i.data<std::string>());
+	EXPECT_EQ(1, s.data<int>());
+}
+
+// testcase: test_zero_copy_value
+// testname: type_id
+TEST_F(test_zero_copy_value, type_id) {
+	EXPECT_EQ(type_id<int>(), type_id<const int&>());
+	EXPECT_NE(type_id<int>(), type_id<unsigned>());
+	EXPECT_NE(type_id<std::string>(), type_id<std::vector<char>>());
+	zero_copy_value x, i(1), s(std::string("s"));
+	EXPECT_EQ(type_id<std::nullptr_t>(), x.id());
+	EXPECT_EQ(type_id<int>(), i.id());
+	EXPECT_EQ(type_id<std::string>(), s.id());
+	EXPECT_EQ(type_id<std::string>(), zero_copy_value::make_unique<std::string>("u").id());
+	EXPECT_TRUE(i == zero_copy_value(1)); // built apart, same type and content
+	EXPECT_TRUE(zero_copy_value(2.5) == zero_copy_value::make_unique<double>(2.5));
+	EXPECT_FALSE(i == zero_copy_value(1u)); // same bytes, another type
+	EXPECT_EQ(type_name<int>(), i.type());
+#ifndef EVENTUAL_NO_RTTI
+	EXPECT_TRUE(s.has_same_type(typeid(std::string)));
+	EXPECT_TRUE(x.has_same_type(typeid(nullptr)));
+	EXPECT_FALSE(i.has_same_type(typeid(long)));
+#endif
+}
+
+// testcase: test_zero_copy_value
+// testname: typed_access
+TEST_F(test_zero_copy_value, typed_access) {
+	zero_copy_value v(std::vector<int>(1000, 7));
+	zero_copy_value shared = v;
+	// no copy: both point into the one shared payload
+	EXPECT_EQ(v.get_if<std::vector<int>>(), shared.get_if<std::vector<int>>());
+	EXPECT_EQ(nullptr, v.get_if<std::string>());
+	EXPECT_EQ(nullptr, x.get_if<int>());
+	EXPECT_TRUE(v.holds<std::vector<int>>());
+	EXPECT_FALSE(v.holds<int>());
+	v.ref<std::vector<int>>()[0] = 8;
+	const zero_copy_value& c = shared;
+	EXPECT_EQ(8, c.cref<std::vector<int>>()[0]);
+	EXPECT_THROW(c.cref<int>(), std::runtime_error);
+
+	zero_copy_value i(1);
+	i.ref<int>()++;
+	EXPECT_EQ(2, *i.get_if<int>());
+	EXPECT_EQ(nullptr, i.get_if<unsigned>());
+	EXPECT_THROW(i.ref<long>(), std::runtime_error);
+}
+
+// counts the deep copies made of it
+struct counted {
+	static int copies;
+	std::vector<char> bytes;
+	explicit counted(size_t n) : bytes(n) {}
+	counted(const counted& d) : bytes(d.bytes) { copies++; }
+	counted(counted&&) = default;
+};
+int counted::copies = 0;
+
+// testcase: test_zero_copy_value
+// testname: in_place
+TEST_F(test_zero_copy_value, in_place) {
+	counted::copies = 0;
+	zero_copy_value a = zero_copy_value::make<counted>(10u << 20);
+	EXPECT_EQ(10u << 20, a.cref<counted>().bytes.size());
+	counted c(16);
+	zero_copy_value b(std::move(c));
+	EXPECT_EQ(16u, b.cref<counted>().bytes.size());
+	counted& e = x.emplace<counted>(32);
+	EXPECT_EQ(&e, x.get_if<counted>());
+	b = counted(8);
+	EXPECT_EQ(8u, b.cref<counted>().bytes.size());
+	EXPECT_EQ(0, counted::copies);
+
+	zero_copy_value i = zero_copy_value::make<int>(3);
+	EXPECT_TRUE(i.is_inline());
+	EXPECT_EQ(4, i.emplace<int>(4));
+	EXPECT_EQ(4, i.data<int>());
+	// an lvalue is still copied
+	zero_copy_value d(e);
+	EXPECT_EQ(1, counted::copies);
+}
+
+// testcase: test_zero_copy_value
+// testname: unique
+TEST_F(test_zero_copy_value, unique) {
+	zero_copy_value u = zero_copy_value::make_unique<std::vector<int>>(100, 1);
+	EXPECT_TRUE(u.is_unique());
+	const std::vector<int>* payload = u.get_if<std::vector<int>>();
+	zero_copy_value moved(std::move(u));
+	EXPECT_TRUE(moved.is_unique());
+	EXPECT_TRUE(u.empty());
+	EXPECT_EQ(payload, moved.get_if<std::vector<int>>());
+	zero_copy_value cloned = moved.copy();
+	EXPECT_TRUE(moved.is_unique());
+	EXPECT_NE(payload, cloned.get_if<std::vector<int>>());
+	// a second holder turns it shared, the payload stays where it is
+	zero_copy_value second = moved;
+	EXPECT_FALSE(moved.is_unique());
+	EXPECT_FALSE(second.is_unique());
+	EXPECT_TRUE(second == moved);
+	EXPECT_EQ(payload, second.get_if<std::vector<int>>());
+	EXPECT_EQ(100u, second.cref<std::vector<int>>().size());
+
+	zero_copy_value a = zero_copy_value::make_unique<std::string>("a"), b(std::string("b"));
+	a.swap(b);
+	EXPECT_TRUE(b.is_unique());
+	EXPECT_EQ("a", b.data<std::string>());
+	EXPECT_EQ("b", a.data<std::string>());
+	a = b;
+	EXPECT_EQ("a", a.data<std::string>());
+	EXPECT_FALSE(zero_copy_value::make_unique<int>(1).is_unique()); // inline: nothing to count anyway
+}
+
+// testcase: test_zero_copy_value
+// testname: mutate
+TEST_F(test_zero_copy_value, mutate) {
+	zero_copy_value v(std::vector<int>(100, 1));
+	const std::vector<int>* original = v.get_if<std::vector<int>>();
+	// the only holder writes in place
+	v.mutate<std::vector<int>>()[0] = 2;
+	EXPECT_EQ(original, v.get_if<std::vector<int>>());
+	// a shared payload is cloned before the write
+	zero_copy_value other = v;
+	v.mutate<std::vector<int>>()[0] = 3;
+	EXPECT_NE(original, v.get_if<std::vector<int>>());
+	EXPECT_EQ(2, other.cref<std::vector<int>>()[0]);
+	EXPECT_EQ(3, v.cref<std::vector<int>>()[0]);
+	EXPECT_TRUE(v.is_unique());
+	// and then it is ours alone again
+	const std::vector<int>* clone = v.get_if<std::vector<int>>();
+	v.mutate<std::vector<int>>().push_back(4);
+	EXPECT_EQ(clone, v.get_if<std::vector<int>>());
+	EXPECT_EQ(other.get_if<std::vector<int>>(), original);
+
+	zero_copy_value i(1), j = i;
+	i.mutate<int>() = 5;
+	EXPECT_EQ(1, j.data<int>());
+	EXPECT_EQ(5, i.data<int>());
+	EXPECT_THROW(i.mutate<double>(), std::runtime_error);
+}
+
+// testcase: test_zero_copy_value
+// testname: slice
+TEST_F(test_zero_copy_value, slice) {
+	std::vector<zero_copy_value> records;
+	const char* base;
+	{
+		zero_copy_value buffer = zero_copy_value::make_unique<std::string>("alpha,beta,gamma");
+		base = buffer.cref<std::string>().data();
+		for (size_t at = 0; at < 16; ) {
+			size_t end = std::min<size_t>(buffer.cref<std::string>().find(',', at), 16);
+			records.push_back(buffer.slice<std::string>(at, end - at));
+			at = end + 1;
+		}
+	} // the buffer value is gone, its payload is kept alive by the slices
+	ASSERT_EQ(3u, records.size());
+	for (auto& r : records) EXPECT_TRUE(r.is_inline());
+	EXPECT_EQ(base, records[0].cref<span<const char>>().data());
+	EXPECT_EQ("beta", records[1].cref<span<const char>>().str());
+	EXPECT_EQ(base + 11, records[2].cref<span<const char>>().data());
+	EXPECT_EQ(5u, records[2].cref<span<const char>>().size());
+
+	// slices of slices share the same parent; slicing past the end clips
+	zero_copy_value mm = records[2].slice<span<const char>>(2, 100);
+	records.clear();
+	EXPECT_EQ("mma", mm.cref<span<const char>>().str());
+	zero_copy_value copied = mm;
+	EXPECT_TRUE(copied == mm);
+	EXPECT_THROW(mm.slice<span<const char>>(4), std::out_of_range);
+	EXPECT_THROW(mm.slice<std::string>(0), std::runtime_error);
+
+	zero_copy_value numbers(std::vector<int>{1, 2, 3, 4});
+	zero_copy_value tail = numbers.slice<std::vector<int>>(2);
+	EXPECT_EQ(2u, tail.cref<span<const int>>().size());
+	EXPECT_EQ(numbers.cref<std::vector<int>>().data() + 2, tail.cref<span<const int>>().data());
+	EXPECT_EQ(3, tail.cref<span<const int>>()[0]);
+}